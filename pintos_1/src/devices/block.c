@@ -3,7 +3,20 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Number of buckets in a device's latency histogram.  Bucket 0
+   counts bios that completed in the tick they were submitted,
+   bucket N counts latencies of 2**(N-1) up to 2**N - 1 ticks,
+   and the last bucket also counts everything slower. */
+#define LATENCY_BUCKET_CNT 8
+
+/* Most sectors that the dispatch thread combines from several
+   bios into one driver request, the most that one IDE command
+   can transfer.  A single larger bio is passed on whole. */
+#define RUN_MAX_SECTORS 256
 
 /* A block device. */
 struct block
@@ -19,6 +32,23 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    unsigned long long cache_hit_cnt;   /* Sector cache hits. */
+    unsigned long long cache_miss_cnt;  /* Sector cache misses. */
+    unsigned long long cache_evict_cnt; /* Sector cache evictions. */
+
+    /* Request queue. */
+    struct lock queue_lock;             /* Protects members below. */
+    struct condition queue_nonempty;    /* Signaled on block_submit(). */
+    struct list queue;                  /* Pending bios, by sector. */
+    bool io_thread_started;             /* Dispatch thread running? */
+    block_sector_t head;                /* Sector after last dispatched. */
+    size_t queue_depth;                 /* Number of pending bios. */
+    size_t max_queue_depth;             /* Highest queue_depth seen. */
+    unsigned long long bio_cnt;         /* Number of bios completed. */
+    unsigned long long merge_cnt;       /* Bios merged into another. */
+    unsigned long long latency[LATENCY_BUCKET_CNT]; /* Latency histogram. */
+    void *run_buffers[RUN_MAX_SECTORS]; /* Buffers of a merged run. */
   };
 
 /* List of all block devices. */
@@ -27,7 +57,18 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
+/* A driver's read_sg or write_sg operation. */
+typedef void sg_func (void *aux, block_sector_t, size_t cnt, void **buffers);
+
 static struct block *list_elem_to_block (struct list_elem *);
+static void do_read (struct block *, block_sector_t, void *);
+static void do_write (struct block *, block_sector_t, const void *);
+static void do_read_range (struct block *, block_sector_t, size_t, void *);
+static void do_write_range (struct block *, block_sector_t, size_t,
+                            const void *);
+static void do_transfer_sg (struct block *, block_sector_t, size_t,
+                            void **, bool write);
+static thread_func io_thread;
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +161,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  do_read (block, sector, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -132,6 +171,75 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
    per-block device locking is unneeded. */
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
+{
+  do_write (block, sector, buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that support it do so with as few commands as
+   possible, rather than one per sector.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_range (struct block *block, block_sector_t sector, size_t cnt,
+                  void *buffer)
+{
+  do_read_range (block, sector, cnt, buffer);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.  Like block_read_range(), uses as few commands as the
+   driver allows.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_range (struct block *block, block_sector_t sector, size_t cnt,
+                   const void *buffer)
+{
+  do_write_range (block, sector, cnt, buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFERS, which holds one BLOCK_SECTOR_SIZE buffer per
+   sector.  The buffers need not be adjacent in memory; drivers
+   that support it still use as few commands as possible.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_sg (struct block *block, block_sector_t sector, size_t cnt,
+               void **buffers)
+{
+  do_transfer_sg (block, sector, cnt, buffers, false);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFERS, which holds one BLOCK_SECTOR_SIZE buffer per sector,
+   like block_read_sg().  Returns after the block device has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_sg (struct block *block, block_sector_t sector, size_t cnt,
+                void **buffers)
+{
+  do_transfer_sg (block, sector, cnt, buffers, true);
+}
+
+/* Reads SECTOR from BLOCK into BUFFER through the driver. */
+static void
+do_read (struct block *block, block_sector_t sector, void *buffer)
+{
+  check_sector (block, sector);
+  block->ops->read (block->aux, sector, buffer);
+  block->read_cnt++;
+}
+
+/* Writes SECTOR to BLOCK from BUFFER through the driver. */
+static void
+do_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
@@ -139,6 +247,323 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   block->write_cnt++;
 }
 
+/* Reads CNT sectors starting at SECTOR from BLOCK into BUFFER
+   through the driver's range operation, or one sector at a time
+   if it has none. */
+static void
+do_read_range (struct block *block, block_sector_t sector, size_t cnt,
+               void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  if (block->ops->read_range != NULL)
+    block->ops->read_range (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->read (block->aux, sector + i,
+                        buffer + i * BLOCK_SECTOR_SIZE);
+  block->read_cnt += cnt;
+}
+
+/* Writes CNT sectors starting at SECTOR to BLOCK from BUFFER
+   through the driver's range operation, or one sector at a time
+   if it has none. */
+static void
+do_write_range (struct block *block, block_sector_t sector, size_t cnt,
+                const void *buffer_)
+{
+  const uint8_t *buffer = buffer_;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->write_range != NULL)
+    block->ops->write_range (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->write (block->aux, sector + i,
+                         buffer + i * BLOCK_SECTOR_SIZE);
+  block->write_cnt += cnt;
+}
+
+/* Returns the driver's scatter-gather operation for reading or,
+   if WRITE is true, writing BLOCK, or a null pointer if it has
+   none. */
+static sg_func *
+sg_op (const struct block *block, bool write)
+{
+  return write ? block->ops->write_sg : block->ops->read_sg;
+}
+
+/* Returns the number of buffers at the start of the CNT in
+   BUFFERS, at least 1, that are adjacent in memory. */
+static size_t
+adjacent_span (void **buffers, size_t cnt)
+{
+  uint8_t *start = buffers[0];
+  size_t span;
+
+  for (span = 1; span < cnt; span++)
+    if (buffers[span] != start + span * BLOCK_SECTOR_SIZE)
+      break;
+  return span;
+}
+
+/* Transfers CNT sectors starting at SECTOR between BLOCK and
+   BUFFERS, one buffer per sector, writing if WRITE is true and
+   reading otherwise.  Uses the driver's scatter-gather
+   operation, or one range operation per span of buffers that
+   are adjacent in memory if it has none. */
+static void
+do_transfer_sg (struct block *block, block_sector_t sector, size_t cnt,
+                void **buffers, bool write)
+{
+  sg_func *sg = sg_op (block, write);
+  size_t i, span;
+
+  if (cnt == 0)
+    return;
+  if (sg == NULL)
+    {
+      for (i = 0; i < cnt; i += span)
+        {
+          span = adjacent_span (buffers + i, cnt - i);
+          if (write)
+            do_write_range (block, sector + i, span, buffers[i]);
+          else
+            do_read_range (block, sector + i, span, buffers[i]);
+        }
+      return;
+    }
+
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (!write || block->type != BLOCK_FOREIGN);
+  sg (block->aux, sector, cnt, buffers);
+  if (write)
+    block->write_cnt += cnt;
+  else
+    block->read_cnt += cnt;
+}
+
+/* Initializes BIO to transfer SECTOR_CNT sectors starting at
+   SECTOR between the device and BUFFERS, writing if WRITE is
+   true.  END, if non-null, is called with BIO and AUX once the
+   transfer is done. */
+void
+bio_init (struct bio *bio, block_sector_t sector, size_t sector_cnt,
+          void **buffers, bool write, bio_end_func *end, void *aux)
+{
+  ASSERT (sector_cnt > 0);
+  ASSERT (buffers != NULL);
+
+  bio->sector = sector;
+  bio->sector_cnt = sector_cnt;
+  bio->buffers = buffers;
+  bio->write = write;
+  bio->end = end;
+  bio->aux = aux;
+  sema_init (&bio->done, 0);
+}
+
+/* Returns true if bio A starts at a lower sector than bio B. */
+static bool
+bio_less (const struct list_elem *a_, const struct list_elem *b_,
+          void *aux UNUSED)
+{
+  const struct bio *a = list_entry (a_, struct bio, elem);
+  const struct bio *b = list_entry (b_, struct bio, elem);
+  return a->sector < b->sector;
+}
+
+/* Queues BIO on BLOCK and returns without waiting for it.  Starts
+   BLOCK's dispatch thread on first use. */
+void
+block_submit (struct block *block, struct bio *bio)
+{
+  check_sector (block, bio->sector);
+  check_sector (block, bio->sector + bio->sector_cnt - 1);
+  ASSERT (!bio->write || block->type != BLOCK_FOREIGN);
+
+  lock_acquire (&block->queue_lock);
+  if (!block->io_thread_started)
+    {
+      char name[sizeof block->name + 3];
+
+      snprintf (name, sizeof name, "%s-io", block->name);
+      if (thread_create (name, PRI_DEFAULT, io_thread, block) == TID_ERROR)
+        PANIC ("%s: couldn't start I/O thread", block->name);
+      block->io_thread_started = true;
+    }
+  bio->submit_time = timer_ticks ();
+  list_insert_ordered (&block->queue, &bio->elem, bio_less, NULL);
+  if (++block->queue_depth > block->max_queue_depth)
+    block->max_queue_depth = block->queue_depth;
+  cond_signal (&block->queue_nonempty, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits until BIO, which must have been submitted, completes. */
+void
+bio_wait (struct bio *bio)
+{
+  sema_down (&bio->done);
+}
+
+/* Removes the next run of bios from BLOCK's queue and moves them
+   to RUN, in sector order, and returns the number of sectors
+   they cover.  The run starts at the first bio at or past the
+   head position, wrapping around to the lowest sector if there
+   is none (C-LOOK), and continues with every queued bio of the
+   same direction that starts where the previous one ended, as
+   long as the run stays within RUN_MAX_SECTORS.  BLOCK's queue
+   lock must be held. */
+static size_t
+take_run (struct block *block, struct list *run)
+{
+  struct list_elem *e;
+  struct bio *first, *prev;
+  size_t sector_cnt;
+
+  ASSERT (!list_empty (&block->queue));
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct bio, elem)->sector >= block->head)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+
+  first = prev = list_entry (e, struct bio, elem);
+  e = list_remove (e);
+  list_push_back (run, &first->elem);
+  block->queue_depth--;
+  sector_cnt = first->sector_cnt;
+
+  while (e != list_end (&block->queue))
+    {
+      struct bio *next = list_entry (e, struct bio, elem);
+      if (next->sector != prev->sector + prev->sector_cnt
+          || next->write != first->write
+          || next->sector_cnt > RUN_MAX_SECTORS - sector_cnt)
+        break;
+      e = list_remove (e);
+      list_push_back (run, &next->elem);
+      block->queue_depth--;
+      sector_cnt += next->sector_cnt;
+      prev = next;
+    }
+  block->head = prev->sector + prev->sector_cnt;
+  return sector_cnt;
+}
+
+/* Gathers the buffers of the bios in RUN, which cover SECTOR_CNT
+   sectors, into a single array and returns it, storing into
+   *MERGE_CNT the number of bios that the driver will transfer in
+   the same request as the bio before them.  Without a
+   scatter-gather operation, that is only the case when a bio's
+   buffers continue the previous bio's in memory. */
+static void **
+gather_run (struct block *block, struct list *run, size_t sector_cnt,
+            size_t *merge_cnt)
+{
+  struct bio *first = list_entry (list_front (run), struct bio, elem);
+  bool sg = sg_op (block, first->write) != NULL;
+  uint8_t *last = NULL;
+  struct list_elem *e;
+  size_t cnt = 0;
+
+  *merge_cnt = 0;
+  if (list_next (&first->elem) == list_end (run))
+    return first->buffers;
+
+  ASSERT (sector_cnt <= RUN_MAX_SECTORS);
+  for (e = list_begin (run); e != list_end (run); e = list_next (e))
+    {
+      struct bio *bio = list_entry (e, struct bio, elem);
+
+      if (last != NULL
+          && (sg || bio->buffers[0] == last + BLOCK_SECTOR_SIZE))
+        (*merge_cnt)++;
+      memcpy (block->run_buffers + cnt, bio->buffers,
+              bio->sector_cnt * sizeof *bio->buffers);
+      cnt += bio->sector_cnt;
+      last = bio->buffers[bio->sector_cnt - 1];
+    }
+  return block->run_buffers;
+}
+
+/* Records the latency of a bio that was submitted at tick
+   SUBMIT_TIME and just completed. */
+static void
+count_latency (struct block *block, int64_t submit_time)
+{
+  int64_t ticks = timer_elapsed (submit_time);
+  int bucket = 0;
+
+  while (ticks > 0 && bucket < LATENCY_BUCKET_CNT - 1)
+    {
+      ticks >>= 1;
+      bucket++;
+    }
+  block->latency[bucket]++;
+}
+
+/* Dispatch thread for block device BLOCK_. */
+static void
+io_thread (void *block_)
+{
+  struct block *block = block_;
+
+  for (;;)
+    {
+      struct list run;
+      struct bio *first;
+      size_t sector_cnt, merge_cnt;
+      void **buffers;
+
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_nonempty, &block->queue_lock);
+      list_init (&run);
+      sector_cnt = take_run (block, &run);
+      lock_release (&block->queue_lock);
+
+      /* Transfer the whole run as one request. */
+      first = list_entry (list_front (&run), struct bio, elem);
+      buffers = gather_run (block, &run, sector_cnt, &merge_cnt);
+      do_transfer_sg (block, first->sector, sector_cnt, buffers,
+                      first->write);
+
+      lock_acquire (&block->queue_lock);
+      block->merge_cnt += merge_cnt;
+      lock_release (&block->queue_lock);
+
+      while (!list_empty (&run))
+        {
+          struct bio *bio = list_entry (list_pop_front (&run),
+                                        struct bio, elem);
+
+          lock_acquire (&block->queue_lock);
+          block->bio_cnt++;
+          count_latency (block, bio->submit_time);
+          lock_release (&block->queue_lock);
+
+          if (bio->end != NULL)
+            bio->end (bio, bio->aux);
+          sema_up (&bio->done);
+        }
+    }
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -174,10 +599,51 @@ block_print_stats (void)
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          if (block->cache_hit_cnt + block->cache_miss_cnt > 0)
+            printf ("%s (%s): cache: %llu hits, %llu misses, "
+                    "%llu evictions\n",
+                    block->name, block_type_name (block->type),
+                    block->cache_hit_cnt, block->cache_miss_cnt,
+                    block->cache_evict_cnt);
+          if (block->bio_cnt > 0)
+            {
+              int j;
+
+              printf ("%s (%s): queue: %llu bios, %llu merged, "
+                      "max depth %zu, latency",
+                      block->name, block_type_name (block->type),
+                      block->bio_cnt, block->merge_cnt,
+                      block->max_queue_depth);
+              for (j = 0; j < LATENCY_BUCKET_CNT; j++)
+                printf (" %llu", block->latency[j]);
+              printf (" (by log2 ticks)\n");
+            }
         }
     }
 }
 
+/* Records EVENT in the sector cache statistics for BLOCK.
+   Called by the cache in filesys/cache.c, which owns no device
+   state of its own. */
+void
+block_count_cache (struct block *block, enum block_cache_event event)
+{
+  switch (event)
+    {
+    case BLOCK_CACHE_HIT:
+      block->cache_hit_cnt++;
+      break;
+    case BLOCK_CACHE_MISS:
+      block->cache_miss_cnt++;
+      break;
+    case BLOCK_CACHE_EVICT:
+      block->cache_evict_cnt++;
+      break;
+    default:
+      NOT_REACHED ();
+    }
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -200,6 +666,19 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->cache_hit_cnt = 0;
+  block->cache_miss_cnt = 0;
+  block->cache_evict_cnt = 0;
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_nonempty);
+  list_init (&block->queue);
+  block->io_thread_started = false;
+  block->head = 0;
+  block->queue_depth = 0;
+  block->max_queue_depth = 0;
+  block->bio_cnt = 0;
+  block->merge_cnt = 0;
+  memset (block->latency, 0, sizeof block->latency);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,18 +55,83 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_range (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_range (struct block *, block_sector_t, size_t cnt,
+                        const void *);
+void block_read_sg (struct block *, block_sector_t, size_t cnt,
+                    void **buffers);
+void block_write_sg (struct block *, block_sector_t, size_t cnt,
+                     void **buffers);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous, queued I/O.
+
+   A bio asks for SECTOR_CNT consecutive sectors, starting at
+   SECTOR, to be read into or written from BUFFERS, which holds
+   one BLOCK_SECTOR_SIZE buffer per sector.  Each device has a
+   queue that a per-device thread dispatches in C-LOOK elevator
+   order, merging bios that continue one another into a single
+   driver request.  When a bio
+   completes, its END function, if any, is called from that
+   thread, and then bio_wait() returns.
+
+   The queue does not order requests for the same sectors, so
+   callers must not have overlapping bios in flight. */
+struct bio;
+typedef void bio_end_func (struct bio *, void *aux);
+
+struct bio
+  {
+    block_sector_t sector;              /* First sector. */
+    size_t sector_cnt;                  /* Number of sectors. */
+    void **buffers;                     /* One buffer per sector. */
+    bool write;                         /* Write, or read? */
+    bio_end_func *end;                  /* Completion callback, or null. */
+    void *aux;                          /* Passed to END. */
+
+    /* Owned by the block layer. */
+    struct list_elem elem;              /* Element in device queue. */
+    int64_t submit_time;                /* Tick of block_submit(). */
+    struct semaphore done;              /* Up'd on completion. */
+  };
+
+void bio_init (struct bio *, block_sector_t sector, size_t sector_cnt,
+               void **buffers, bool write, bio_end_func *, void *aux);
+void block_submit (struct block *, struct bio *);
+void bio_wait (struct bio *);
+
 /* Statistics. */
 void block_print_stats (void);
+
+/* Events reported by a sector cache layered over a device. */
+enum block_cache_event
+  {
+    BLOCK_CACHE_HIT,             /* Sector found in the cache. */
+    BLOCK_CACHE_MISS,            /* Sector had to be read or allocated. */
+    BLOCK_CACHE_EVICT            /* Cached sector was replaced. */
+  };
+
+void block_count_cache (struct block *, enum block_cache_event);
 
 /* Lower-level interface to block device drivers. */
 
+/* READ and WRITE transfer a single sector.  READ_RANGE and
+   WRITE_RANGE, which a driver may leave null, transfer CNT
+   consecutive sectors to or from one contiguous buffer, ideally
+   with far fewer device commands than CNT separate calls.
+   READ_SG and WRITE_SG, which may also be null, do the same for
+   CNT sectors whose buffers, one BLOCK_SECTOR_SIZE buffer per
+   sector in BUFFERS, need not be adjacent in memory. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_range) (void *aux, block_sector_t, size_t cnt, void *buffer);
+    void (*write_range) (void *aux, block_sector_t, size_t cnt,
+                         const void *buffer);
+    void (*read_sg) (void *aux, block_sector_t, size_t cnt, void **buffers);
+    void (*write_sg) (void *aux, block_sector_t, size_t cnt, void **buffers);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -3,12 +3,16 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -30,10 +34,27 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* PCI bus master IDE port addresses, relative to the channel's
+   range in the controller's BAR4, as laid out by the
+   "Programming Interface for Bus Master IDE Controller" spec. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
+#define STA_DF 0x20             /* Device Fault. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus master command register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master status register bits. */
+#define BM_STA_ERROR 0x02       /* Transfer failed; write 1 to clear. */
+#define BM_STA_INTR 0x04        /* Disk interrupted; write 1 to clear. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +70,36 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Physical region descriptor.  A channel's PRD table lists the
+   physical memory regions of one bus master transfer.  No region
+   may cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address, even. */
+    uint16_t size;              /* Size in bytes, 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+
+#define PRD_EOT 0x8000                          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))  /* Entries per table. */
+
+/* Most sectors that one READ or WRITE command can transfer. */
+#define MAX_CMD_SECTORS 256
+
+/* The memory side of a transfer: either one contiguous buffer,
+   or one BLOCK_SECTOR_SIZE buffer per sector that need not be
+   adjacent to each other. */
+struct ide_buffers
+  {
+    uint8_t *base;              /* Contiguous buffer, or null. */
+    void **vec;                 /* Per-sector buffers, if BASE is null. */
+  };
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +108,9 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool use_dma;               /* Transfer with bus master DMA? */
+    int multiple;               /* Sectors per READ/WRITE MULTIPLE
+                                   interrupt, 0 if not enabled. */
   };
 
 /* An ATA channel (aka controller).
@@ -66,6 +120,8 @@ struct channel
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master base port, 0 if none. */
+    struct prd *prdt;           /* PRD table, if bm_base != 0. */
 
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
@@ -85,8 +141,18 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static uint16_t find_bus_master (void);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
+static void set_multiple_mode (struct ata_disk *, int sectors);
+static void ide_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          const struct ide_buffers *, bool write);
+static void pio_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          const struct ide_buffers *, size_t first,
+                          bool write);
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          const struct ide_buffers *, size_t first,
+                          bool write);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
@@ -102,6 +168,7 @@ void
 ide_init (void) 
 {
   size_t chan_no;
+  uint16_t bm_base = find_bus_master ();
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
@@ -126,6 +193,16 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+
+      /* Each channel has 8 bus master ports, primary first. */
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + 8 * chan_no;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +213,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->use_dma = false;
+          d->multiple = 0;
         }
 
       /* Register interrupt handler. */
@@ -155,6 +234,39 @@ ide_init (void)
     }
 }
 
+/* Looks for a PCI IDE controller that can act as a bus master
+   and whose two channels are in compatibility mode, that is, at
+   the legacy ports that we drive.  If one is found, enables bus
+   mastering and returns its bus master base port.  Otherwise,
+   returns 0, and all transfers use PIO. */
+static uint16_t
+find_bus_master (void)
+{
+  struct pci_addr addr;
+  uint32_t cls, bar4;
+  uint8_t prog_if;
+
+  if (!pci_find_class (0x01, 0x01, &addr))
+    return 0;
+
+  /* Prog-if bit 7: bus master capable.  Bits 0 and 2: primary and
+     secondary channels in native PCI mode. */
+  cls = pci_read_config (&addr, PCI_REG_CLASS);
+  prog_if = cls >> 8;
+  if ((prog_if & 0x80) == 0 || (prog_if & 0x05) != 0)
+    return 0;
+
+  /* BAR4 must be an I/O space range. */
+  bar4 = pci_read_config (&addr, PCI_REG_BAR (4));
+  if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+    return 0;
+
+  pci_write_config (&addr, PCI_REG_COMMAND,
+                    (pci_read_config (&addr, PCI_REG_COMMAND)
+                     | PCI_CMD_IO | PCI_CMD_MASTER));
+  return bar4 & 0xfffc;
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
@@ -289,6 +401,22 @@ identify_ata_device (struct ata_disk *d)
   snprintf (extra_info, sizeof extra_info,
             "model \"%s\", serial \"%s\"", model, serial);
 
+  /* Word 49 bit 8 says whether the disk supports DMA. */
+  d->use_dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+  if (d->use_dma)
+    strlcat (extra_info, ", DMA", sizeof extra_info);
+
+  /* Word 47 bits 0-7 give the most sectors the disk can transfer
+     per interrupt with READ/WRITE MULTIPLE. */
+  set_multiple_mode (d, *(uint16_t *) &id[47 * 2] & 0xff);
+  if (d->multiple > 1)
+    {
+      char multiple_info[32];
+      snprintf (multiple_info, sizeof multiple_info,
+                ", %d sectors/interrupt", d->multiple);
+      strlcat (extra_info, multiple_info, sizeof extra_info);
+    }
+
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
      allow access to those, we're less likely to scribble on
@@ -337,6 +465,56 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Uses
+   one DMA or PIO command per MAX_CMD_SECTORS sectors.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_range (void *d, block_sector_t sec_no, size_t cnt, void *buffer)
+{
+  struct ide_buffers b = { buffer, NULL };
+  ide_transfer (d, sec_no, cnt, &b, false);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_range (void *d, block_sector_t sec_no, size_t cnt,
+                 const void *buffer)
+{
+  struct ide_buffers b = { (uint8_t *) buffer, NULL };
+  ide_transfer (d, sec_no, cnt, &b, true);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFERS,
+   one BLOCK_SECTOR_SIZE buffer per sector.  A DMA transfer lists
+   each buffer in the PRD table, so scattered buffers still take
+   one command per MAX_CMD_SECTORS sectors.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_sg (void *d, block_sector_t sec_no, size_t cnt, void **buffers)
+{
+  struct ide_buffers b = { NULL, buffers };
+  ide_transfer (d, sec_no, cnt, &b, false);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFERS,
+   one BLOCK_SECTOR_SIZE buffer per sector, like ide_read_sg().
+   Returns after the disk has acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_sg (void *d, block_sector_t sec_no, size_t cnt, void **buffers)
+{
+  struct ide_buffers b = { NULL, buffers };
+  ide_transfer (d, sec_no, cnt, &b, true);
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
@@ -344,16 +522,7 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  ide_read_range (d_, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -364,36 +533,61 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  ide_write_range (d_, sec_no, 1, buffer);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_range,
+    ide_write_range,
+    ide_read_sg,
+    ide_write_sg
   };
+
+/* Returns the buffer for sector I of a transfer to or from B. */
+static void *
+sector_buffer (const struct ide_buffers *b, size_t i)
+{
+  return b->base != NULL ? b->base + i * BLOCK_SECTOR_SIZE : b->vec[i];
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and B,
+   reading if WRITE is false and writing otherwise, with one DMA
+   or PIO command per MAX_CMD_SECTORS sectors. */
+static void
+ide_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              const struct ide_buffers *b, bool write)
+{
+  struct channel *c = d->channel;
+  size_t done, chunk;
+
+  lock_acquire (&c->lock);
+  for (done = 0; done < cnt; done += chunk)
+    {
+      chunk = cnt - done < MAX_CMD_SECTORS ? cnt - done : MAX_CMD_SECTORS;
+      if (!d->use_dma
+          || !dma_transfer (d, sec_no + done, chunk, b, done, write))
+        pio_transfer (d, sec_no + done, chunk, b, done, write);
+    }
+  lock_release (&c->lock);
+}
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number of sectors CNT, which must be
+   between 1 and 256, to the disk's sector selection registers.
+   (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= 256);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -414,6 +608,169 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
+/* Asks disk D to interrupt once per SECTORS sectors, instead of
+   once per sector, during READ MULTIPLE and WRITE MULTIPLE
+   commands, and records the setting in D if the disk accepts
+   it. */
+static void
+set_multiple_mode (struct ata_disk *d, int sectors)
+{
+  struct channel *c = d->channel;
+
+  if (sectors <= 1)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), sectors);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & (STA_ERR | STA_DF)) == 0)
+    d->multiple = sectors;
+}
+
+/* Transfers CNT sectors, between 1 and MAX_CMD_SECTORS, starting
+   at SEC_NO between disk D and the buffers for sectors FIRST
+   onward in B with a single PIO command, reading into them if
+   WRITE is false and writing from them otherwise.  The disk interrupts once per D->multiple sectors
+   if multiple mode is enabled, and once per sector otherwise.
+   The caller must hold D's channel lock. */
+static void
+pio_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              const struct ide_buffers *b, size_t first, bool write)
+{
+  struct channel *c = d->channel;
+  size_t per_intr = d->multiple > 1 && cnt > 1 ? (size_t) d->multiple : 1;
+  uint8_t command;
+  size_t done = 0;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  if (per_intr > 1)
+    command = write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+  else
+    command = write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, command);
+
+  /* A read interrupts when each block of data is ready.  A write
+     asks for the first block at once and interrupts after each
+     block has been received. */
+  while (done < cnt)
+    {
+      size_t block_end = done + per_intr < cnt ? done + per_intr : cnt;
+
+      if (!write)
+        sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+               d->name, write ? "write" : "read", sec_no + done);
+      for (; done < block_end; done++)
+        if (write)
+          output_sector (c, sector_buffer (b, first + done));
+        else
+          input_sector (c, sector_buffer (b, first + done));
+      if (write)
+        sema_down (&c->completion_wait);
+    }
+}
+
+/* Fills in channel C's PRD table to describe the buffers for
+   the CNT sectors starting at sector FIRST of B, one entry per
+   physically contiguous piece.  Returns false if a buffer cannot
+   be the target of a bus master transfer or the pieces do not
+   fit in the table, in which case the caller should fall back to
+   PIO. */
+static bool
+build_prdt (struct channel *c, const struct ide_buffers *b, size_t first,
+            size_t cnt)
+{
+  uintptr_t end = 0;
+  size_t i, n = 0;
+
+  for (i = first; i < first + cnt; i++)
+    {
+      const void *buffer = sector_buffer (b, i);
+      uintptr_t paddr;
+      size_t size = BLOCK_SECTOR_SIZE;
+
+      /* Kernel virtual memory maps physical memory one-to-one, so
+         each sector's buffer is physically contiguous. */
+      if (!is_kernel_vaddr (buffer) || (uintptr_t) buffer % 2 != 0)
+        return false;
+
+      paddr = vtop (buffer);
+      while (size > 0)
+        {
+          size_t chunk = 0x10000 - (paddr & 0xffff);
+          if (chunk > size)
+            chunk = size;
+
+          /* Extend the previous entry if this piece follows it
+             without starting a new 64 kB region.  A size of 0
+             means 64 kB, which is what the sum wraps to. */
+          if (n > 0 && paddr == end && (paddr & 0xffff) != 0)
+            c->prdt[n - 1].size = (c->prdt[n - 1].size + chunk) & 0xffff;
+          else
+            {
+              if (n >= PRD_CNT)
+                return false;
+              c->prdt[n].addr = paddr;
+              c->prdt[n].size = chunk & 0xffff;
+              c->prdt[n].flags = 0;
+              n++;
+            }
+          paddr += chunk;
+          end = paddr;
+          size -= chunk;
+        }
+    }
+  c->prdt[n - 1].flags = PRD_EOT;
+  return true;
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   the buffers for sectors FIRST onward in B with a single bus
+   master DMA command, reading into them if WRITE is false and
+   writing from them otherwise.  The caller must hold D's channel
+   lock.  Returns false without touching the disk if the buffers
+   are unsuitable for DMA. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              const struct ide_buffers *b, size_t first, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t bm_status, status;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+  ASSERT (c->bm_base != 0);
+
+  if (!build_prdt (c, b, first, cnt))
+    return false;
+
+  /* Program the bus master, then the disk, then start. */
+  outb (reg_bm_command (c), 0);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c),
+        inb (reg_bm_status (c)) | BM_STA_ERROR | BM_STA_INTR);
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+
+  /* The disk interrupts once the whole transfer is done. */
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), 0);
+  bm_status = inb (reg_bm_status (c));
+  status = inb (reg_alt_status (c));
+  outb (reg_bm_status (c), bm_status | BM_STA_ERROR | BM_STA_INTR);
+  if ((bm_status & BM_STA_ERROR) != 0 || (status & (STA_ERR | STA_DF)) != 0)
+    PANIC ("%s: DMA %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+  return true;
+}
+
 /* Reads a sector from channel C's data register in PIO mode into
    SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
 static void
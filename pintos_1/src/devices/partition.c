@@ -317,8 +317,56 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads CNT sectors starting at SECTOR from partition P into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
+static void
+partition_read_range (void *p_, block_sector_t sector, size_t cnt,
+                      void *buffer)
+{
+  struct partition *p = p_;
+  block_read_range (p->block, p->start + sector, cnt, buffer);
+}
+
+/* Writes CNT sectors starting at SECTOR to partition P from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block has acknowledged receiving the
+   data. */
+static void
+partition_write_range (void *p_, block_sector_t sector, size_t cnt,
+                       const void *buffer)
+{
+  struct partition *p = p_;
+  block_write_range (p->block, p->start + sector, cnt, buffer);
+}
+
+/* Reads CNT sectors starting at SECTOR from partition P into
+   BUFFERS, one BLOCK_SECTOR_SIZE buffer per sector. */
+static void
+partition_read_sg (void *p_, block_sector_t sector, size_t cnt,
+                   void **buffers)
+{
+  struct partition *p = p_;
+  block_read_sg (p->block, p->start + sector, cnt, buffers);
+}
+
+/* Writes CNT sectors starting at SECTOR to partition P from
+   BUFFERS, one BLOCK_SECTOR_SIZE buffer per sector.  Returns
+   after the block has acknowledged receiving the data. */
+static void
+partition_write_sg (void *p_, block_sector_t sector, size_t cnt,
+                    void **buffers)
+{
+  struct partition *p = p_;
+  block_write_sg (p->block, p->start + sector, cnt, buffers);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_range,
+    partition_write_range,
+    partition_read_sg,
+    partition_write_sg
   };
@@ -0,0 +1,99 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/io.h"
+
+/* Minimal access to PCI configuration space, using the type 1
+   mechanism (I/O ports 0xcf8 and 0xcfc) found in every PC
+   chipset that Pintos runs on. */
+
+#define PCI_PORT_ADDRESS 0xcf8  /* Configuration address. */
+#define PCI_PORT_DATA 0xcfc     /* Configuration data. */
+
+/* Number of buses and devices scanned by pci_find_class().
+   Emulators put everything on bus 0, but a few more buses are
+   cheap to check. */
+#define PCI_BUS_CNT 8
+#define PCI_DEV_CNT 32
+#define PCI_FUNC_CNT 8
+
+/* Selects register REG of function ADDR in the configuration
+   address port. */
+static void
+select_register (const struct pci_addr *addr, uint8_t reg)
+{
+  outl (PCI_PORT_ADDRESS, (0x80000000u | (addr->bus << 16)
+                           | (addr->dev << 11) | (addr->func << 8)
+                           | (reg & 0xfc)));
+}
+
+/* Returns the 32-bit configuration register REG of function
+   ADDR.  REG must be a multiple of 4. */
+uint32_t
+pci_read_config (const struct pci_addr *addr, uint8_t reg)
+{
+  enum intr_level old_level;
+  uint32_t value;
+
+  ASSERT (reg % 4 == 0);
+
+  old_level = intr_disable ();
+  select_register (addr, reg);
+  value = inl (PCI_PORT_DATA);
+  intr_set_level (old_level);
+  return value;
+}
+
+/* Writes VALUE to the 32-bit configuration register REG of
+   function ADDR.  REG must be a multiple of 4. */
+void
+pci_write_config (const struct pci_addr *addr, uint8_t reg, uint32_t value)
+{
+  enum intr_level old_level;
+
+  ASSERT (reg % 4 == 0);
+
+  old_level = intr_disable ();
+  select_register (addr, reg);
+  outl (PCI_PORT_DATA, value);
+  intr_set_level (old_level);
+}
+
+/* Searches for the first PCI function whose class code is CLASS
+   and whose subclass is SUBCLASS.  If one is found, stores its
+   location in *ADDR and returns true.  Returns false if there is
+   no such function or no PCI bus at all, in which case every
+   read returns all 1-bits. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_addr *addr)
+{
+  struct pci_addr a;
+  int bus, dev, func;
+
+  for (bus = 0; bus < PCI_BUS_CNT; bus++)
+    for (dev = 0; dev < PCI_DEV_CNT; dev++)
+      for (func = 0; func < PCI_FUNC_CNT; func++)
+        {
+          uint32_t id, cls;
+
+          a.bus = bus;
+          a.dev = dev;
+          a.func = func;
+          id = pci_read_config (&a, PCI_REG_ID);
+          if ((id & 0xffff) == 0xffff)
+            {
+              /* No function 0 means no device at all. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          cls = pci_read_config (&a, PCI_REG_CLASS);
+          if ((cls >> 24) == class && ((cls >> 16) & 0xff) == subclass)
+            {
+              *addr = a;
+              return true;
+            }
+        }
+  return false;
+}
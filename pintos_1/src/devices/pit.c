@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,66 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts a one-shot countdown of COUNT PIT cycles on CHANNEL,
+   using mode 0 ("interrupt on terminal count").  The channel's
+   output drops to 0 as soon as the count is loaded and rises to
+   1 when the count reaches 0, where it stays until the channel
+   is reprogrammed.  On channel 0 that rising edge raises a
+   single timer interrupt.
+
+   Callers typically switch back to periodic mode with
+   pit_configure_channel() once the countdown has expired. */
+void
+pit_start_oneshot (int channel, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (count > 0);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30 | (0 << 1));
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the current value of CHANNEL's down-counter.  In mode
+   0 the value is only meaningful while pit_output_high()
+   returns false: after the terminal count the counter keeps
+   wrapping around. */
+uint16_t
+pit_read_count (int channel)
+{
+  enum intr_level old_level;
+  uint16_t count;
+
+  ASSERT (channel >= 0 && channel <= 2);
+
+  /* Counter latch command, then low and high bytes. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+  return count;
+}
+
+/* Returns the state of CHANNEL's output pin, using the 8254
+   read-back command to latch the channel's status byte. */
+bool
+pit_output_high (int channel)
+{
+  enum intr_level old_level;
+  uint8_t status;
+
+  ASSERT (channel >= 0 && channel <= 2);
+
+  /* Read-back command: latch status only, for CHANNEL. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | 0x20 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  intr_set_level (old_level);
+  return (status & 0x80) != 0;
+}
@@ -3,8 +3,10 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -20,8 +22,32 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
-/* block list는 sleep 상태의 스레드를 모아놓은 리스트입니다. */
-static struct list block_list;
+/* sleep 상태의 스레드를 wake_tick이 작은 순서(같다면 priority가 높은 순서)로
+   정렬한 최소 힙입니다. sleep_heap[0]이 가장 먼저 깨어날 스레드입니다. */
+static struct thread **sleep_heap;
+static size_t sleep_cnt;        /* # of threads in sleep_heap. */
+static size_t sleep_cap;        /* Allocated size of sleep_heap. */
+#define SLEEP_HEAP_INIT_CAP 64
+
+/* 가장 먼저 깨어날 스레드의 wake_tick입니다. 잠든 스레드가 없으면
+   INT64_MAX이므로, 깨울 스레드가 없는 tick에서는 비교 한 번으로 끝납니다. */
+static int64_t next_wake_tick;
+
+/* "-tickless" 옵션으로 켜집니다. 켜져 있으면 idle thread가 쉬는 동안
+   PIT를 one-shot으로 맞춰서 깨울 스레드가 없는 tick의 인터럽트를 건너뜁니다. */
+bool timer_tickless;
+
+/* tickless idle 상태입니다. oneshot_armed이면 PIT channel 0이 mode 0으로
+   oneshot_count 사이클을 세고 있고, 끝나면 oneshot_ticks만큼의 tick을
+   한꺼번에 처리합니다. */
+static bool oneshot_armed;
+static uint16_t oneshot_count;      /* PIT cycles programmed. */
+static unsigned oneshot_ticks;      /* Ticks covered by the countdown. */
+static bool oneshot_stale_irq;      /* Swallow the next timer interrupt. */
+static unsigned pit_per_tick;       /* PIT cycles per timer tick. */
+static unsigned oneshot_max_ticks;  /* Longest countdown, in ticks. */
+static int64_t tickless_periods;    /* # of one-shot idle periods. */
+static int64_t tickless_ticks;      /* # of ticks with no interrupt. */
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
@@ -32,6 +58,11 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void timer_advance (void);
+static bool sleep_before (const struct thread *, const struct thread *);
+static void sleep_heap_grow (size_t old_cap);
+static void sleep_heap_push (struct thread *);
+static struct thread *sleep_heap_pop (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -39,9 +70,16 @@ void
 timer_init (void) 
 { 
   pit_configure_channel (0, 2, TIMER_FREQ);
+  pit_per_tick = (PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ;
+  oneshot_max_ticks = UINT16_MAX / pit_per_tick;
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-  /* sleep시 아래 리스트를 사용할 것이기 때문에 타이머를 초기화할 때 같이 초기화 시켜 줍니다. */
-  list_init (&block_list);
+  /* sleep시 아래 힙을 사용할 것이기 때문에 타이머를 초기화할 때 같이 초기화 시켜 줍니다. */
+  sleep_heap = malloc (SLEEP_HEAP_INIT_CAP * sizeof *sleep_heap);
+  if (sleep_heap == NULL)
+    PANIC ("timer: couldn't allocate sleep queue");
+  sleep_cnt = 0;
+  sleep_cap = SLEEP_HEAP_INIT_CAP;
+  next_wake_tick = INT64_MAX;
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -97,42 +135,195 @@ timer_sleep (int64_t ticks)
   int64_t start = timer_ticks ();
   ASSERT (intr_get_level () == INTR_ON); 
  
-  /*수정된 timer_sleep입니다. 지금 시간으로 부터 시간을 ticks만큼 더해서 스레드 구조체의 wake_tick에 저장하고 sleep상태의 스레드들을 모아넣는 block_list에 집어넣습니다. 그 후 스레드를 block합니다.*/ 
+  /*수정된 timer_sleep입니다. 지금 시간으로 부터 시간을 ticks만큼 더해서 스레드 구조체의 wake_tick에 저장하고 sleep상태의 스레드들을 모아넣는 sleep_heap에 집어넣습니다. 그 후 스레드를 block합니다.
+    힙이 가득 찼다면 인터럽트를 켠 상태에서 먼저 힙을 늘립니다.*/ 
   struct thread * sleep_t = thread_current();
+  enum intr_level old_level;
 
+  if (ticks <= 0)
+    return;
 
-  enum intr_level old_level;
-  old_level = intr_disable();
+  for (;;)
+    {
+      size_t cap;
+
+      old_level = intr_disable ();
+      if (sleep_cnt < sleep_cap)
+        break;
+      cap = sleep_cap;
+      intr_set_level (old_level);
+      sleep_heap_grow (cap);
+    }
   sleep_t->wake_tick = start + ticks;
-
-  list_push_back(&block_list,&sleep_t->elem);
+  sleep_heap_push (sleep_t);
+  if (sleep_t->wake_tick < next_wake_tick)
+    next_wake_tick = sleep_t->wake_tick;
   thread_block();
   intr_set_level(old_level); 
-  
 }
-/* 타이머를 깨우는 함수입니다. timer_interrupt에서 매번 작동되며 block_list를 참조하여 현재 시간이 wake_tick보다 크다면 block_list에서 빼내고 thread를 unblock시켜서 ready_list에 포함시킵니다. */
+
+/* 타이머를 깨우는 함수입니다. timer_interrupt에서 next_wake_tick이 지났을 때만 호출되며 sleep_heap의 맨 위부터 wake_tick이 지난 스레드들을 꺼내 unblock시켜서 ready queue에 포함시킵니다. 깨운 스레드가 현재 스레드보다 priority가 높다면 인터럽트가 끝날 때 양보합니다. */
 void
 timer_wake (void)
 {
- int64_t temp_tick = timer_ticks();
- 
- struct thread *cur_thr;
- struct list_elem *cur_elem;
- cur_elem =  list_begin(&block_list);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (sleep_cnt > 0 && sleep_heap[0]->wake_tick <= ticks)
+    {
+      struct thread *t = sleep_heap_pop ();
 
+      thread_unblock (t);
+      if (intr_context () && t->priority > thread_current ()->priority)
+        intr_yield_on_return ();
+    }
+  next_wake_tick = sleep_cnt > 0 ? sleep_heap[0]->wake_tick : INT64_MAX;
+}
 
-  while(cur_elem != list_end(&block_list) )
-  {
-    cur_thr = list_entry(cur_elem,struct thread,elem);
-  
-     if(temp_tick >= (cur_thr->wake_tick))
-      {
-        cur_elem = list_remove(&cur_thr->elem);
-        thread_unblock(cur_thr); 
-      }
-     else
-      cur_elem = list_next(cur_elem); 
-  }
+/* idle thread가 hlt하기 직전에 인터럽트가 꺼진 상태로 호출합니다. 다음에
+   깨울 스레드가 두 tick 이상 남았다면 그때(최대 oneshot_max_ticks tick 뒤)
+   한 번만 인터럽트가 오도록 PIT를 one-shot으로 맞춥니다. */
+void
+timer_idle_enter (void)
+{
+  int64_t delta;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_armed)
+    return;
+  delta = next_wake_tick - ticks;
+  if (delta <= 1 || oneshot_max_ticks <= 1)
+    return;
+  if (delta > oneshot_max_ticks)
+    delta = oneshot_max_ticks;
+
+  oneshot_ticks = delta;
+  oneshot_count = delta * pit_per_tick;
+  oneshot_armed = true;
+  tickless_periods++;
+  pit_start_oneshot (0, oneshot_count);
+}
+
+/* idle thread가 CPU를 내어줄 때 인터럽트가 꺼진 상태로 호출합니다. one-shot이
+   아직 끝나지 않았다면 지나간 tick만큼 시간을 따라잡고, 남은 tick의 나머지
+   사이클 뒤에 다시 인터럽트가 오도록 짧은 one-shot을 맞춥니다. 그 인터럽트에서
+   주기 모드로 돌아갑니다. */
+void
+timer_idle_exit (void)
+{
+  unsigned elapsed, whole;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!oneshot_armed || oneshot_ticks <= 1)
+    return;
+
+  if (pit_output_high (0))
+    {
+      /* 이미 끝났지만 인터럽트는 아직 처리되지 않았습니다. 여기서 idle thread의
+         몫으로 처리하고, 곧 들어올 인터럽트는 버립니다. */
+      whole = oneshot_ticks;
+      oneshot_armed = false;
+      oneshot_stale_irq = true;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+  else
+    {
+      elapsed = oneshot_count - pit_read_count (0);
+      whole = elapsed / pit_per_tick;
+      oneshot_ticks = 1;
+      oneshot_count = pit_per_tick - elapsed % pit_per_tick;
+      pit_start_oneshot (0, oneshot_count);
+    }
+
+  tickless_ticks += whole;
+  while (whole-- > 0)
+    timer_advance ();
+}
+
+/* A가 B보다 먼저 깨어나야 하면 true를 리턴합니다. 같은 tick에 깨어난다면
+   priority가 높은 스레드가 먼저입니다. */
+static bool
+sleep_before (const struct thread *a, const struct thread *b) 
+{
+  if (a->wake_tick != b->wake_tick)
+    return a->wake_tick < b->wake_tick;
+  return a->priority > b->priority;
+}
+
+/* sleep_heap의 크기를 OLD_CAP의 두 배로 늘립니다. malloc()은 잠들 수 있으므로
+   인터럽트가 켜진 상태에서 호출해야 하고, 그 사이에 다른 스레드가 이미
+   늘렸다면 새로 할당한 배열은 버립니다. */
+static void
+sleep_heap_grow (size_t old_cap) 
+{
+  struct thread **new_heap;
+  struct thread **old_heap;
+  enum intr_level old_level;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  new_heap = malloc (old_cap * 2 * sizeof *new_heap);
+  if (new_heap == NULL)
+    PANIC ("timer: couldn't grow sleep queue to %zu entries", old_cap * 2);
+
+  old_level = intr_disable ();
+  if (sleep_cap == old_cap)
+    {
+      memcpy (new_heap, sleep_heap, sleep_cnt * sizeof *new_heap);
+      old_heap = sleep_heap;
+      sleep_heap = new_heap;
+      sleep_cap = old_cap * 2;
+    }
+  else
+    old_heap = new_heap;
+  intr_set_level (old_level);
+
+  free (old_heap);
+}
+
+/* T를 sleep_heap에 넣습니다. 빈 자리가 있어야 하며 인터럽트는 꺼져 있어야 합니다. */
+static void
+sleep_heap_push (struct thread *t) 
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sleep_cnt < sleep_cap);
+
+  for (i = sleep_cnt++; i > 0; i = (i - 1) / 2)
+    {
+      struct thread *parent = sleep_heap[(i - 1) / 2];
+      if (!sleep_before (t, parent))
+        break;
+      sleep_heap[i] = parent;
+    }
+  sleep_heap[i] = t;
+}
+
+/* sleep_heap에서 가장 먼저 깨어나야 할 스레드를 꺼내서 리턴합니다. */
+static struct thread *
+sleep_heap_pop (void) 
+{
+  struct thread *top, *last;
+  size_t i, child;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sleep_cnt > 0);
+
+  top = sleep_heap[0];
+  last = sleep_heap[--sleep_cnt];
+  for (i = 0; (child = 2 * i + 1) < sleep_cnt; i = child)
+    {
+      if (child + 1 < sleep_cnt
+          && sleep_before (sleep_heap[child + 1], sleep_heap[child]))
+        child++;
+      if (!sleep_before (sleep_heap[child], last))
+        break;
+      sleep_heap[i] = sleep_heap[child];
+    }
+  sleep_heap[i] = last;
+  return top;
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -203,12 +394,40 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (timer_tickless)
+    printf ("Timer: %"PRId64" tickless idle periods, %"PRId64" ticks "
+            "without an interrupt\n", tickless_periods, tickless_ticks);
 }
 
 /* Timer interrupt handler. */
-/* timer_interrupt에서 타이머 기상 작업을 진행합니다. 시간을 증가시키고 시스템에 적용시킨 후 mlfqs가 아니라면 timer_wake을 실행합니다. 만약 mlfqs라면 priority와 관련된 요소들을 업데이트 시킨 후 timer_wake을 실행합니다. */
+/* one-shot이 끝났다면 주기 모드로 되돌리고 그동안 건너뛴 tick까지 한꺼번에
+   처리합니다. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
+{
+  unsigned n = 1;
+
+  if (oneshot_stale_irq)
+    {
+      oneshot_stale_irq = false;
+      return;
+    }
+  if (oneshot_armed)
+    {
+      n = oneshot_ticks;
+      oneshot_armed = false;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      tickless_ticks += n - 1;
+    }
+  while (n-- > 0)
+    timer_advance ();
+}
+
+/* 한 tick을 진행합니다. */
+/* timer_interrupt에서 타이머 기상 작업을 진행합니다. 시간을 증가시키고 시스템에 적용시킨 후 mlfqs가 아니라면 timer_wake을 실행합니다. 만약 mlfqs라면 priority와 관련된 요소들을 업데이트 시킨 후 timer_wake을 실행합니다. timer_wake은 깨울 스레드가 있는 tick에서만 실행됩니다.
+   timer_idle_exit()에서 놓친 tick을 따라잡을 때도 호출됩니다. */
+static void
+timer_advance (void)
 {
   ticks++; 
   thread_tick ();
@@ -217,13 +436,13 @@ timer_interrupt (struct intr_frame *args UNUSED)
    if(ticks % TIMER_FREQ == 0)
    { mlfqs_load_avg();
      mlfqs_recalc();
-
    }
    if(ticks%4 == 0)
    mlfqs_priority(thread_current());
  }
   
-  timer_wake();
+  if (ticks >= next_wake_tick)
+    timer_wake ();
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
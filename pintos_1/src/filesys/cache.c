@@ -0,0 +1,489 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* fs_device의 섹터를 담아두는 버퍼 캐시입니다. inode.c는 block_read()와
+   block_write() 대신 이 모듈을 거쳐서 디스크에 접근합니다.
+
+   cache_lock은 각 엔트리가 어떤 섹터를 담고 있는지(sector, valid)와
+   pin_cnt, accessed, clock_hand를 보호합니다. 엔트리의 lock은 data와
+   dirty를 보호하고, 섹터를 읽어 들이는 동안에도 잡혀 있으므로 같은 섹터를
+   찾은 다른 스레드는 읽기가 끝날 때까지 기다립니다. pin된 엔트리는 쫓겨나지
+   않으며, 엔트리의 lock을 잡으려면 먼저 pin해야 합니다.
+
+   저널의 트랜잭션에 들어 있는 메타데이터 섹터(held)와 지금 로그에 쓰고
+   있는 섹터(logging)는 커밋이 끝날 때까지 제자리에 쓰지 않으므로 쫓아내지도
+   않습니다. 이 두 값도 엔트리의 lock이 보호하며, pin되지 않은 엔트리에서는
+   바뀌지 않습니다. */
+
+#define CACHE_SIZE 64                   /* Number of cached sectors. */
+#define WRITE_BEHIND_TICKS TIMER_FREQ   /* Write-behind period. */
+#define READ_AHEAD_MAX 16               /* Queued read-ahead requests. */
+#define RANGE_BIO_CNT 4                 /* Bios in flight per range read. */
+#define RANGE_BIO_SECTORS 16            /* Sectors per range read bio. */
+
+/* 캐시 엔트리 하나입니다. */
+struct cache_entry
+  {
+    block_sector_t sector;      /* Sector held, if valid. */
+    bool valid;                 /* Holds a sector? */
+    bool accessed;              /* Used since the clock hand passed? */
+    int pin_cnt;                /* # of users; pinned entries stay. */
+    struct lock lock;           /* Protects data and dirty. */
+    bool dirty;                 /* Differs from disk? */
+    bool held;                  /* In the journal's running transaction? */
+    bool logging;               /* Being written to the journal's log? */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_unpinned; /* Signaled when pin_cnt drops to 0. */
+static size_t clock_hand;
+
+/* 미리 읽을 섹터들의 원형 큐입니다. 가득 차면 요청을 버립니다. */
+static block_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head;
+static size_t read_ahead_cnt;
+static struct lock read_ahead_lock;
+static struct condition read_ahead_nonempty;
+
+static void write_at (block_sector_t, const void *, int ofs, int size,
+                      bool meta);
+static struct cache_entry *cache_get (block_sector_t, bool load);
+static void cache_put (struct cache_entry *);
+static struct cache_entry *cache_find (block_sector_t);
+static struct cache_entry *cache_pick_victim (void);
+static void read_sectors (block_sector_t, size_t cnt, uint8_t *buffer);
+static thread_func write_behind;
+static thread_func read_ahead;
+
+/* 버퍼 캐시를 초기화하고 write-behind, read-ahead 스레드를 만듭니다.
+   fs_device가 정해진 뒤에 호출해야 합니다. */
+void
+cache_init (void)
+{
+  size_t per_page = PGSIZE / BLOCK_SECTOR_SIZE;
+  uint8_t *pages;
+  size_t i;
+
+  pages = palloc_get_multiple (PAL_ASSERT, CACHE_SIZE / per_page);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      e->valid = false;
+      e->accessed = false;
+      e->pin_cnt = 0;
+      e->dirty = false;
+      e->held = false;
+      e->logging = false;
+      lock_init (&e->lock);
+      e->data = pages + i * BLOCK_SECTOR_SIZE;
+    }
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  clock_hand = 0;
+
+  read_ahead_head = read_ahead_cnt = 0;
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_nonempty);
+
+  thread_create ("cache-flush", PRI_DEFAULT, write_behind, NULL);
+  thread_create ("cache-ahead", PRI_DEFAULT, read_ahead, NULL);
+}
+
+/* dirty한 엔트리를 모두 디스크에 씁니다. 쓰기를 한꺼번에 요청해 두고
+   기다리므로 장치의 엘리베이터가 섹터 순서로 정렬하고 이어지는 섹터들을
+   합쳐서 처리합니다. 요청을 담을 메모리가 없으면 하나씩 씁니다. 아직
+   커밋되지 않은 메타데이터 섹터는 건너뜁니다. */
+void
+cache_flush (void)
+{
+  struct cache_entry *flushing[CACHE_SIZE];
+  struct bio *bios;
+  size_t i, cnt = 0;
+
+  bios = malloc (CACHE_SIZE * sizeof *bios);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&cache_lock);
+      if (!e->valid)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      if (!e->dirty || e->held || e->logging)
+        cache_put (e);
+      else if (bios == NULL)
+        {
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+          cache_put (e);
+        }
+      else
+        {
+          /* E는 쓰기가 끝날 때까지 lock을 잡은 채로 둡니다. */
+          bio_init (&bios[cnt], e->sector, 1, (void **) &e->data, true,
+                    NULL, NULL);
+          block_submit (fs_device, &bios[cnt]);
+          e->dirty = false;
+          flushing[cnt++] = e;
+        }
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      bio_wait (&bios[i]);
+      cache_put (flushing[i]);
+    }
+  free (bios);
+}
+
+/* SECTOR 전체를 BUFFER로 읽습니다. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* BUFFER의 내용을 SECTOR 전체에 씁니다. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* SECTOR의 OFS 바이트부터 SIZE 바이트를 BUFFER로 읽습니다. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* BUFFER의 SIZE 바이트를 SECTOR의 OFS 바이트부터 씁니다. 섹터 전체를 덮어쓰는
+   경우에는 디스크에서 먼저 읽지 않습니다. 디스크에는 write-behind 스레드나
+   쫓겨날 때, 또는 cache_flush()에서 쓰입니다. */
+void
+cache_write_at (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  write_at (sector, buffer, ofs, size, false);
+}
+
+/* 메타데이터 섹터 전체를 씁니다. cache_write_meta_at()을 보십시오. */
+void
+cache_write_meta (block_sector_t sector, const void *buffer)
+{
+  write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE, true);
+}
+
+/* cache_write_at()과 같지만 SECTOR를 저널의 현재 트랜잭션에 넣습니다.
+   SECTOR는 트랜잭션이 커밋된 뒤에야 제자리에 쓰입니다. */
+void
+cache_write_meta_at (block_sector_t sector, const void *buffer,
+                     int ofs, int size)
+{
+  write_at (sector, buffer, ofs, size, true);
+}
+
+/* 커밋하는 저널이 부릅니다. 트랜잭션에 든 SECTOR의 지금 내용을 BUFFER로
+   복사하고, 로그에 쓰는 중이라고 표시합니다. 이후에 SECTOR가 다시 쓰이면
+   다음 트랜잭션에 들어갑니다. */
+void
+cache_log_copy (block_sector_t sector, void *buffer)
+{
+  struct cache_entry *e = cache_get (sector, true);
+
+  memcpy (buffer, e->data, BLOCK_SECTOR_SIZE);
+  e->held = false;
+  e->logging = true;
+  cache_put (e);
+}
+
+/* 커밋하는 저널이 부릅니다. SECTOR가 로그에 커밋되었으므로 이제 제자리에
+   쓸 수 있습니다. */
+void
+cache_log_done (block_sector_t sector)
+{
+  struct cache_entry *e = cache_get (sector, true);
+
+  e->logging = false;
+  cache_put (e);
+}
+
+/* SECTOR부터 CNT개의 연속된 섹터를 BUFFER로 읽습니다. 캐시에 있는 섹터는
+   캐시에서 복사하고, 캐시에 없는 섹터들은 이어지는 것끼리 묶어
+   read_sectors()로 읽습니다. 큰 순차 읽기용이므로 디스크에서 읽은 섹터는
+   캐시에 넣지 않습니다.
+
+   dirty한 섹터는 디스크에 쓰여 깨끗해진 뒤에야 캐시에서 쫓겨나므로,
+   cache_lock 아래에서 캐시에 없다고 확인한 섹터는 디스크의 내용이
+   최신입니다. */
+void
+cache_read_range (block_sector_t sector, size_t cnt, void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      size_t run = 0;
+
+      lock_acquire (&cache_lock);
+      while (i + run < cnt && cache_find (sector + i + run) == NULL)
+        run++;
+      lock_release (&cache_lock);
+
+      if (run > 0)
+        {
+          read_sectors (sector + i, run, buffer + i * BLOCK_SECTOR_SIZE);
+          i += run;
+        }
+      else
+        {
+          cache_read (sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+          i++;
+        }
+    }
+}
+
+/* SECTOR를 read-ahead 스레드가 미리 읽어 두도록 요청하고 바로 리턴합니다. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_MAX)
+    {
+      size_t tail = (read_ahead_head + read_ahead_cnt++) % READ_AHEAD_MAX;
+      read_ahead_queue[tail] = sector;
+      cond_signal (&read_ahead_nonempty, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* SECTOR를 담은 엔트리를 pin하고 lock을 잡은 채로 리턴합니다. 캐시에 없으면
+   clock 알고리즘으로 고른 엔트리를 비우고 LOAD가 true일 때만 디스크에서
+   읽어 옵니다. 모든 엔트리가 pin되어 있으면 하나가 풀릴 때까지 기다립니다. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = cache_find (sector);
+      if (e != NULL)
+        {
+          e->pin_cnt++;
+          e->accessed = true;
+          block_count_cache (fs_device, BLOCK_CACHE_HIT);
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          return e;
+        }
+
+      e = cache_pick_victim ();
+      if (e == NULL)
+        cond_wait (&cache_unpinned, &cache_lock);
+      else if (e->valid && e->dirty)
+        {
+          /* dirty한 희생 엔트리는 pin해서 다른 스레드가 쫓아내지 못하게
+             하고, cache_lock을 놓은 채로 디스크에 씁니다. 그동안 그
+             섹터를 찾은 스레드는 E의 lock을 기다립니다. 깨끗해진 뒤에는
+             처음부터 다시 찾습니다. 기다리는 동안 SECTOR가 캐시에 들어왔을
+             수도 있기 때문입니다. */
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          if (e->dirty && !e->held && !e->logging)
+            {
+              block_write (fs_device, e->sector, e->data);
+              e->dirty = false;
+            }
+          cache_put (e);
+          lock_acquire (&cache_lock);
+        }
+      else
+        break;
+    }
+
+  /* E는 깨끗하고 pin되어 있지 않으므로 lock도 비어 있고, 디스크 쓰기
+     없이 바로 다른 섹터에 쓸 수 있습니다. */
+  block_count_cache (fs_device, BLOCK_CACHE_MISS);
+  lock_acquire (&e->lock);
+  if (e->valid)
+    block_count_cache (fs_device, BLOCK_CACHE_EVICT);
+  e->sector = sector;
+  e->valid = true;
+  e->accessed = true;
+  e->pin_cnt = 1;
+  e->dirty = false;
+  e->held = false;
+  e->logging = false;
+  lock_release (&cache_lock);
+
+  if (load)
+    read_sectors (sector, 1, e->data);
+  return e;
+}
+
+/* fs_device의 SECTOR부터 CNT개의 섹터를 BUFFER로 읽습니다. 다른 스레드의
+   요청과 함께 엘리베이터 순서로 처리되도록 장치의 큐를 거쳐서 읽습니다.
+   RANGE_BIO_SECTORS개씩 나눈 bio를 RANGE_BIO_CNT개까지 한꺼번에 넣어
+   두므로, 이어지는 bio들은 디스패치 스레드가 한 번의 요청으로 합칩니다. */
+static void
+read_sectors (block_sector_t sector, size_t cnt, uint8_t *buffer)
+{
+  struct bio bios[RANGE_BIO_CNT];
+  void *buffers[RANGE_BIO_CNT][RANGE_BIO_SECTORS];
+
+  while (cnt > 0)
+    {
+      size_t n, i;
+
+      for (n = 0; n < RANGE_BIO_CNT && cnt > 0; n++)
+        {
+          size_t part = cnt < RANGE_BIO_SECTORS ? cnt : RANGE_BIO_SECTORS;
+
+          for (i = 0; i < part; i++)
+            buffers[n][i] = buffer + i * BLOCK_SECTOR_SIZE;
+          bio_init (&bios[n], sector, part, buffers[n], false, NULL, NULL);
+          block_submit (fs_device, &bios[n]);
+          sector += part;
+          buffer += part * BLOCK_SECTOR_SIZE;
+          cnt -= part;
+        }
+      for (i = 0; i < n; i++)
+        bio_wait (&bios[i]);
+    }
+}
+
+/* cache_write_at()과 cache_write_meta_at()의 구현입니다. META가 true면
+   SECTOR를 저널의 현재 트랜잭션에 넣습니다. 이미 들어 있더라도 저널이
+   SECTOR의 revoke를 지울 수 있도록 알립니다. */
+static void
+write_at (block_sector_t sector, const void *buffer, int ofs, int size,
+          bool meta)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, ofs != 0 || size != BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  if (meta && journal_add (sector))
+    e->held = true;
+  cache_put (e);
+}
+
+/* cache_get()으로 얻은 E의 lock을 놓고 pin을 풉니다. */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+  lock_acquire (&cache_lock);
+  if (--e->pin_cnt == 0)
+    cond_signal (&cache_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* SECTOR를 담은 엔트리를 찾습니다. cache_lock을 잡고 호출해야 합니다. */
+static struct cache_entry *
+cache_find (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* clock 알고리즘으로 쫓아낼 엔트리를 고릅니다. 빈 엔트리가 있으면 먼저
+   쓰고, 두 바퀴를 돌아도 pin되지 않고 저널에 묶이지 않은 엔트리가 없으면
+   NULL을 리턴합니다. cache_lock을 잡고 호출해야 합니다. */
+static struct cache_entry *
+cache_pick_victim (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (!e->valid)
+        return e;
+      if (e->pin_cnt > 0 || e->held || e->logging)
+        continue;
+      if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* WRITE_BEHIND_TICKS마다 저널의 트랜잭션을 커밋하고 dirty한 엔트리를
+   디스크에 씁니다. */
+static void
+write_behind (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (WRITE_BEHIND_TICKS);
+      journal_commit ();
+      cache_flush ();
+    }
+}
+
+/* cache_read_ahead()로 요청된 섹터를 캐시에 읽어 둡니다. 이미 캐시에
+   있는 섹터는 건너뜁니다. */
+static void
+read_ahead (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      bool cached;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_nonempty, &read_ahead_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      lock_acquire (&cache_lock);
+      cached = cache_find (sector) != NULL;
+      lock_release (&cache_lock);
+      if (!cached)
+        cache_put (cache_get (sector, true));
+    }
+}
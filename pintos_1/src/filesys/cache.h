@@ -0,0 +1,22 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+
+void cache_init (void);
+void cache_flush (void);
+
+void cache_read (block_sector_t, void *);
+void cache_write (block_sector_t, const void *);
+void cache_read_at (block_sector_t, void *, int ofs, int size);
+void cache_write_at (block_sector_t, const void *, int ofs, int size);
+void cache_read_ahead (block_sector_t);
+void cache_read_range (block_sector_t, size_t cnt, void *);
+
+/* Metadata writes, which go through the journal. */
+void cache_write_meta (block_sector_t, const void *);
+void cache_write_meta_at (block_sector_t, const void *, int ofs, int size);
+void cache_log_copy (block_sector_t, void *);
+void cache_log_done (block_sector_t);
+
+#endif /* filesys/cache.h */
@@ -1,10 +1,15 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
@@ -14,6 +19,9 @@ struct dir
   };
 
 /* A single directory entry. */
+/* in_use가 false이고 inode_sector가 0이면 한 번도 쓰이지 않은 빈 칸이고,
+   inode_sector가 0이 아니면 지워진 칸(tombstone)입니다. 0번 섹터는 free
+   map의 inode이므로 파일의 inode가 될 수 없습니다. */
 struct dir_entry 
   {
     block_sector_t inode_sector;        /* Sector number of header. */
@@ -21,12 +29,174 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* 디렉터리 파일은 섹터 하나 크기의 버킷들로 이루어진 해시 테이블입니다.
+   이름은 hash_string(name) % 버킷 수 번째 버킷부터 차례로 살펴보고, 빈
+   칸이 남아 있는 버킷을 만나면 거기서 찾기를 멈춥니다. 새 이름이 자기
+   버킷에서 MAX_PROBE개보다 멀리 밀려나면 버킷 수를 두 배로 늘리고 다시
+   배치합니다. 버킷 수는 파일 길이에서 구합니다. */
+#define ENTRIES_PER_BUCKET (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+#define MAX_PROBE 4
+
+/* 버킷 하나입니다. 섹터의 나머지 바이트는 쓰지 않습니다. */
+struct dir_bucket
+  {
+    struct dir_entry entries[ENTRIES_PER_BUCKET];
+    uint8_t unused[BLOCK_SECTOR_SIZE
+                   - ENTRIES_PER_BUCKET * sizeof (struct dir_entry)];
+  };
+
+/* 최근에 찾은 이름을 기억하는 direct-mapped 이름 캐시입니다. 디렉터리의
+   inode 섹터와 이름으로 자리를 정하고, 그 디렉터리 파일 안에서의 엔트리
+   위치를 함께 기억해서 dir_remove()도 디스크를 뒤지지 않게 합니다.
+   디렉터리의 rwlock을 쓰기로 잡은 쪽이 디렉터리를 바꿀 때 함께 고칩니다. */
+#define NAME_CACHE_SIZE 256
+
+struct name_cache_entry
+  {
+    bool valid;
+    block_sector_t dir_sector;          /* Directory's inode sector. */
+    block_sector_t inode_sector;        /* Entry's inode sector. */
+    off_t ofs;                          /* Entry's offset in directory. */
+    char name[NAME_MAX + 1];
+  };
+
+static struct name_cache_entry name_cache[NAME_CACHE_SIZE];
+static struct lock name_cache_lock;
+
+/* struct dir과 작업용 버킷을 정확한 크기로 할당하는 slab 캐시입니다. */
+static struct kmem_cache *dir_cache;
+static struct kmem_cache *bucket_cache;
+
+static bool lookup (const struct dir *, const char *name,
+                    struct dir_entry *, off_t *);
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  lock_init (&name_cache_lock);
+  dir_cache = kmem_cache_create (sizeof (struct dir), NULL);
+  bucket_cache = kmem_cache_create (sizeof (struct dir_bucket), NULL);
+  if (dir_cache == NULL || bucket_cache == NULL)
+    PANIC ("can't create directory caches");
+}
+
+/* DIR의 내용을 보호하는 rwlock을 리턴합니다. rwlock은 디렉터리의 inode에
+   있으므로 서로 다른 디렉터리는 따로 잠깁니다. 찾기와 readdir은 읽기로,
+   추가와 삭제는 쓰기로 잡습니다. */
+static struct rwlock *
+dir_lock (const struct dir *dir)
+{
+  return inode_dir_lock (dir->inode);
+}
+
+/* DIR에 있는 버킷 수를 리턴합니다. */
+static size_t
+bucket_cnt (const struct dir *dir)
+{
+  return inode_length (dir->inode) / BLOCK_SECTOR_SIZE;
+}
+
+/* BUCKET번째 버킷의 IDX번째 엔트리의 파일 안 위치를 리턴합니다. */
+static off_t
+entry_ofs (size_t bucket, size_t idx)
+{
+  return bucket * BLOCK_SECTOR_SIZE + idx * sizeof (struct dir_entry);
+}
+
+/* DIR의 BUCKET번째 버킷을 B로 읽습니다. */
+static bool
+read_bucket (const struct dir *dir, size_t bucket, struct dir_bucket *b)
+{
+  return (inode_read_at (dir->inode, b, sizeof *b, entry_ofs (bucket, 0))
+          == sizeof *b);
+}
+
+/* DIR_SECTOR 디렉터리의 NAME이 들어갈 이름 캐시 자리를 리턴합니다. */
+static struct name_cache_entry *
+name_cache_slot (block_sector_t dir_sector, const char *name)
+{
+  unsigned h = hash_string (name) ^ hash_int (dir_sector);
+  return &name_cache[h % NAME_CACHE_SIZE];
+}
+
+/* DIR의 NAME을 이름 캐시에서 찾아서 *EP와 *OFSP를 채웁니다. */
+static bool
+name_cache_lookup (const struct dir *dir, const char *name,
+                   struct dir_entry *ep, off_t *ofsp)
+{
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  struct name_cache_entry *c = name_cache_slot (dir_sector, name);
+  bool found;
+
+  lock_acquire (&name_cache_lock);
+  found = c->valid && c->dir_sector == dir_sector && !strcmp (c->name, name);
+  if (found)
+    {
+      if (ep != NULL)
+        {
+          ep->inode_sector = c->inode_sector;
+          strlcpy (ep->name, c->name, sizeof ep->name);
+          ep->in_use = true;
+        }
+      if (ofsp != NULL)
+        *ofsp = c->ofs;
+    }
+  lock_release (&name_cache_lock);
+  return found;
+}
+
+/* DIR의 OFS 위치에 있는 엔트리 E를 이름 캐시에 넣습니다. */
+static void
+name_cache_insert (const struct dir *dir, const struct dir_entry *e,
+                   off_t ofs)
+{
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  struct name_cache_entry *c = name_cache_slot (dir_sector, e->name);
+
+  lock_acquire (&name_cache_lock);
+  c->valid = true;
+  c->dir_sector = dir_sector;
+  c->inode_sector = e->inode_sector;
+  c->ofs = ofs;
+  strlcpy (c->name, e->name, sizeof c->name);
+  lock_release (&name_cache_lock);
+}
+
+/* 이름 캐시에서 DIR_SECTOR 디렉터리의 NAME을 지웁니다. NAME이 null이면
+   그 디렉터리의 이름을 모두 지웁니다. */
+static void
+name_cache_invalidate (block_sector_t dir_sector, const char *name)
+{
+  size_t i;
+
+  lock_acquire (&name_cache_lock);
+  if (name != NULL)
+    {
+      struct name_cache_entry *c = name_cache_slot (dir_sector, name);
+      if (c->valid && c->dir_sector == dir_sector && !strcmp (c->name, name))
+        c->valid = false;
+    }
+  else
+    for (i = 0; i < NAME_CACHE_SIZE; i++)
+      if (name_cache[i].dir_sector == dir_sector)
+        name_cache[i].valid = false;
+  lock_release (&name_cache_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
+/* 버킷 수는 ENTRY_CNT개가 들어갈 만큼으로, 최소 하나입니다. 새 파일은 0으로
+   채워져 있으므로 모든 칸이 빈 칸입니다. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  size_t buckets = DIV_ROUND_UP (entry_cnt, ENTRIES_PER_BUCKET);
+
+  if (buckets == 0)
+    buckets = 1;
+  name_cache_invalidate (sector, NULL);
+  return inode_create (sector, buckets * BLOCK_SECTOR_SIZE);
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -34,17 +204,18 @@ dir_create (block_sector_t sector, size_t entry_cnt)
 struct dir *
 dir_open (struct inode *inode) 
 {
-  struct dir *dir = calloc (1, sizeof *dir);
+  struct dir *dir = kmem_cache_alloc (dir_cache);
   if (inode != NULL && dir != NULL)
     {
       dir->inode = inode;
       dir->pos = 0;
+      inode_set_metadata (inode);
       return dir;
     }
   else
     {
       inode_close (inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
       return NULL; 
     }
 }
@@ -72,7 +243,7 @@ dir_close (struct dir *dir)
   if (dir != NULL)
     {
       inode_close (dir->inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
     }
 }
 
@@ -88,27 +259,56 @@ dir_get_inode (struct dir *dir)
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
    otherwise, returns false and ignores EP and OFSP. */
+/* 이름 캐시에 없으면 NAME의 버킷부터 빈 칸이 남은 버킷을 만날 때까지만
+   살펴봅니다. */
 static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
-  
+  struct dir_bucket *b;
+  size_t n, probe;
+  bool found = false;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  if (name_cache_lookup (dir, name, ep, ofsp))
+    return true;
+
+  b = kmem_cache_alloc (bucket_cache);
+  if (b == NULL)
+    return false;
+
+  n = bucket_cnt (dir);
+  for (probe = 0; probe < n && !found; probe++)
+    {
+      size_t bucket = (hash_string (name) + probe) % n;
+      bool saw_empty = false;
+      size_t i;
+
+      if (!read_bucket (dir, bucket, b))
+        break;
+      for (i = 0; i < ENTRIES_PER_BUCKET; i++)
+        {
+          struct dir_entry *e = &b->entries[i];
+          if (e->in_use && !strcmp (name, e->name))
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = entry_ofs (bucket, i);
+              name_cache_insert (dir, e, entry_ofs (bucket, i));
+              found = true;
+              break;
+            }
+          else if (!e->in_use && e->inode_sector == 0)
+            saw_empty = true;
+        }
+      if (saw_empty)
+        break;
+    }
+  kmem_cache_free (bucket_cache, b);
+  return found;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -124,14 +324,111 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  rwlock_acquire_read (dir_lock (dir));
   if (lookup (dir, name, &e, NULL))
     *inode = inode_open (e.inode_sector);
   else
     *inode = NULL;
+  rwlock_release_read (dir_lock (dir));
 
   return *inode != NULL;
 }
 
+/* E를 DIR에 넣을 자리를 찾아서 씁니다. E의 버킷부터 MAX_PROBE개의 버킷
+   안에서 빈 칸이나 지워진 칸을 찾되, ANY_PROBE가 true라면 테이블 끝까지
+   찾습니다. 자리를 찾아서 썼다면 true를 리턴합니다. */
+static bool
+insert_entry (struct dir *dir, const struct dir_entry *e,
+              struct dir_bucket *b, bool any_probe)
+{
+  size_t n = bucket_cnt (dir);
+  size_t limit = any_probe || n < MAX_PROBE + 1 ? n : MAX_PROBE + 1;
+  size_t probe;
+
+  for (probe = 0; probe < limit; probe++)
+    {
+      size_t bucket = (hash_string (e->name) + probe) % n;
+      size_t i;
+
+      if (!read_bucket (dir, bucket, b))
+        return false;
+      for (i = 0; i < ENTRIES_PER_BUCKET; i++)
+        if (!b->entries[i].in_use)
+          {
+            off_t ofs = entry_ofs (bucket, i);
+            if (inode_write_at (dir->inode, e, sizeof *e, ofs) != sizeof *e)
+              return false;
+            name_cache_insert (dir, e, ofs);
+            return true;
+          }
+    }
+  return false;
+}
+
+/* DIR의 버킷 수를 두 배로 늘리고 쓰이고 있는 엔트리를 다시 배치합니다.
+   지워진 칸도 이때 정리됩니다. B는 버킷 하나 크기의 작업 버퍼입니다.
+
+   새 테이블은 새로 할당한 임시 inode에 다 만든 뒤 inode_exchange()로
+   DIR의 inode와 한 번에 맞바꾸므로, 도중에 실패하거나 시스템이 멈춰도
+   DIR은 예전 테이블을 그대로 가지고 있습니다. 맞바꾸기 전에는 아무도 새
+   테이블을 보지 않으므로, 버킷들은 저널을 거치지 않고 써서 트랜잭션 하나에
+   다 들어가지 않아도 되게 하고, 맞바꾸기 전에 디스크에 내립니다. 맞바꾼
+   뒤에는 임시 inode를 지워서 예전 테이블의 섹터들을 돌려줍니다. */
+static bool
+grow (struct dir *dir, struct dir_bucket *b)
+{
+  size_t old_n = bucket_cnt (dir);
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  block_sector_t new_sector;
+  struct dir new_dir;
+  size_t bucket, i;
+  bool success = true;
+
+  if (!free_map_allocate_near (dir_sector, 1, &new_sector))
+    return false;
+  if (!inode_create (new_sector, 2 * old_n * BLOCK_SECTOR_SIZE))
+    {
+      free_map_release (new_sector, 1);
+      return false;
+    }
+  new_dir.inode = inode_open (new_sector);
+  new_dir.pos = 0;
+  if (new_dir.inode == NULL)
+    {
+      free_map_release (new_sector, 1);
+      return false;
+    }
+  /* 쓰이고 있는 엔트리를 새 테이블에 옮깁니다. 새 테이블은 hole이라
+     처음에는 모든 칸이 빈 칸입니다. */
+  for (bucket = 0; bucket < old_n && success; bucket++)
+    {
+      struct dir_entry entries[ENTRIES_PER_BUCKET];
+      size_t cnt = 0;
+
+      if (!read_bucket (dir, bucket, b))
+        {
+          success = false;
+          break;
+        }
+      for (i = 0; i < ENTRIES_PER_BUCKET; i++)
+        if (b->entries[i].in_use)
+          entries[cnt++] = b->entries[i];
+      for (i = 0; i < cnt && success; i++)
+        success = insert_entry (&new_dir, &entries[i], b, true);
+    }
+
+  if (success)
+    {
+      cache_flush ();
+      inode_exchange (dir->inode, new_dir.inode);
+      name_cache_invalidate (dir_sector, NULL);
+    }
+  name_cache_invalidate (new_sector, NULL);
+  inode_remove (new_dir.inode);
+  inode_close (new_dir.inode);
+  return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -142,7 +439,7 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
-  off_t ofs;
+  struct dir_bucket *b = NULL;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -152,35 +449,34 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  rwlock_acquire_write (dir_lock (dir));
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  b = kmem_cache_alloc (bucket_cache);
+  if (b == NULL)
+    goto done;
 
-  /* Write slot. */
+  /* Write slot, growing the table if NAME's buckets are full. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  while (!(success = insert_entry (dir, &e, b, false)))
+    if (!grow (dir, b))
+      break;
 
  done:
+  kmem_cache_free (bucket_cache, b);
+  rwlock_release_write (dir_lock (dir));
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
    which occurs only if there is no file with the given NAME. */
+/* 지운 칸은 inode_sector를 남겨서 지워진 칸으로 표시합니다. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
@@ -192,6 +488,8 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  rwlock_acquire_write (dir_lock (dir));
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -205,12 +503,14 @@ dir_remove (struct dir *dir, const char *name)
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  name_cache_invalidate (inode_get_inumber (dir->inode), name);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  rwlock_release_write (dir_lock (dir));
   inode_close (inode);
   return success;
 }
@@ -218,19 +518,27 @@ dir_remove (struct dir *dir, const char *name)
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
+/* DIR->pos는 버킷을 차례로 이어 붙였을 때의 엔트리 번호입니다. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  rwlock_acquire_read (dir_lock (dir));
+  while (!found
+         && inode_read_at (dir->inode, &e, sizeof e,
+                           entry_ofs (dir->pos / ENTRIES_PER_BUCKET,
+                                      dir->pos % ENTRIES_PER_BUCKET))
+            == sizeof e)
     {
-      dir->pos += sizeof e;
+      dir->pos++;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
+          found = true;
+        }
     }
-  return false;
+  rwlock_release_read (dir_lock (dir));
+  return found;
 }
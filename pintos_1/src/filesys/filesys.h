@@ -8,6 +8,10 @@
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
 
+/* Metadata journal: a header sector followed by the log. */
+#define JOURNAL_SECTOR 2        /* Journal header sector. */
+#define JOURNAL_LOG_CNT 128     /* Number of log sectors after it. */
+
 /* Block device that contains the file system. */
 struct block *fs_device;
 
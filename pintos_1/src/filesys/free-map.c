@@ -1,13 +1,27 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* free map 파일의 섹터마다 하나씩, 아직 파일에 쓰지 않은 변경이 있는지
+   나타냅니다. 할당과 해제는 이 비트만 켜 두고, free_map_flush()가 켜진
+   섹터만 파일에 씁니다. */
+static struct bitmap *dirty_sectors;
+static struct lock free_map_lock;    /* Protects the two bitmaps above. */
+
+/* Number of sector bits in one sector of the free map file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+static void mark_dirty (block_sector_t, size_t cnt);
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
@@ -17,36 +31,98 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, 1 + JOURNAL_LOG_CNT, true);
+
+  dirty_sectors = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                               BLOCK_SECTOR_SIZE));
+  if (dirty_sectors == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
+/* 변경된 free map 섹터는 dirty로 표시만 하고, 파일에는
+   free_map_flush()에서 씁니다. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (0, cnt, sectorp);
+}
+
+/* free_map_allocate()와 같지만 GOAL 섹터부터 찾기 시작해서, 가능하면 GOAL
+   바로 뒤의 빈 섹터들을 할당합니다. GOAL 뒤에 빈 공간이 없으면 처음부터
+   다시 찾습니다. 파일의 다음 블록을 이전 블록이나 inode 가까이에 두는 데
+   씁니다. */
+bool
+free_map_allocate_near (block_sector_t goal, size_t cnt,
+                        block_sector_t *sectorp)
+{
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_near (free_map, goal, cnt, false);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      mark_dirty (sector, cnt);
     }
+  lock_release (&free_map_lock);
+
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
+/* 로그에 사본이 남은 섹터가 재사용된 뒤 예전 내용으로 덮이지 않도록
+   저널에 revoke를 남깁니다. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  size_t i;
+
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+
+  for (i = 0; i < cnt; i++)
+    journal_revoke (sector + i);
+}
+
+/* dirty로 표시된 free map 섹터들을 free map 파일에 씁니다. 파일은 버퍼
+   캐시를 거치므로 디스크에는 캐시의 write-behind가 씁니다. free map
+   파일은 만들 때 모든 섹터가 할당되므로 여기서 다시 free_map_allocate()를
+   부르지 않습니다. */
+void
+free_map_flush (void)
+{
+  size_t idx = 0;
+
+  lock_acquire (&free_map_lock);
+  if (free_map_file != NULL)
+    while ((idx = bitmap_scan_and_flip (dirty_sectors, idx, 1, true))
+           != BITMAP_ERROR)
+      if (!bitmap_write_part (free_map, free_map_file,
+                              idx * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+        PANIC ("can't write free map");
+  lock_release (&free_map_lock);
+}
+
+/* SECTOR부터 CNT개의 섹터를 나타내는 비트가 들어 있는 free map 파일
+   섹터들을 dirty로 표시합니다. free_map_lock을 잡고 호출해야 합니다. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+  bitmap_set_multiple (dirty_sectors, first, last - first + 1, true);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,19 +132,32 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_metadata (file_get_inode (free_map_file));
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
 }
 
 /* Writes the free map to disk and closes the free map file. */
+/* 남은 변경은 저널 커밋이 free_map_flush()로 씁니다. */
 void
 free_map_close (void) 
 {
-  file_close (free_map_file);
+  struct file *file;
+
+  journal_commit ();
+  lock_acquire (&free_map_lock);
+  file = free_map_file;
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
+  file_close (file);
 }
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
+/* inode_create()는 데이터 섹터를 할당하지 않으므로 파일 섹터는
+   bitmap_write()가 처음 쓰면서 모두 할당합니다. 그 할당이 이미 쓴 섹터의
+   비트를 바꿀 수 있으므로 dirty 표시는 지우지 않고, 남은 변경은 다음
+   free_map_flush()가 씁니다. */
 void
 free_map_create (void) 
 {
@@ -80,6 +169,7 @@ free_map_create (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_metadata (file_get_inode (free_map_file));
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
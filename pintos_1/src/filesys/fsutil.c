@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +12,76 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* 스크래치 장치와 주고받는 데이터를 한 페이지씩 묶어서 비동기로 요청합니다.
+   한 묶음이 전송되는 동안 다른 묶음을 파일에서 채우거나 파일에 씁니다. */
+#define BATCH_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+struct batch
+  {
+    struct bio bio;                     /* Request in flight. */
+    void *buffers[BATCH_SECTORS];       /* Sectors of DATA. */
+    uint8_t *data;                      /* One page. */
+    size_t sector_cnt;                  /* Sectors in current request. */
+    bool pending;                       /* Submitted, not yet waited for? */
+  };
+
+/* BATCHES[0]과 BATCHES[1]에 페이지를 할당합니다. */
+static void
+batches_init (struct batch batches[2])
+{
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      size_t j;
+
+      batches[i].data = palloc_get_page (PAL_ASSERT);
+      for (j = 0; j < BATCH_SECTORS; j++)
+        batches[i].buffers[j] = batches[i].data + j * BLOCK_SECTOR_SIZE;
+      batches[i].pending = false;
+    }
+}
+
+/* 끝나지 않은 요청을 기다린 뒤 페이지를 돌려줍니다. */
+static void
+batches_done (struct batch batches[2])
+{
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      if (batches[i].pending)
+        bio_wait (&batches[i].bio);
+      palloc_free_page (batches[i].data);
+    }
+}
+
+/* B의 처음 CNT개 섹터를 BLOCK의 SECTOR부터 읽거나(WRITE가 false) 쓰도록
+   요청하고 바로 리턴합니다. */
+static void
+batch_submit (struct block *block, struct batch *b, block_sector_t sector,
+              size_t cnt, bool write)
+{
+  ASSERT (!b->pending);
+  ASSERT (cnt > 0 && cnt <= BATCH_SECTORS);
+
+  b->sector_cnt = cnt;
+  b->pending = true;
+  bio_init (&b->bio, sector, cnt, b->buffers, write, NULL, NULL);
+  block_submit (block, &b->bio);
+}
+
+/* B에 대한 요청이 있다면 끝날 때까지 기다립니다. */
+static void
+batch_wait (struct batch *b)
+{
+  if (b->pending)
+    {
+      bio_wait (&b->bio);
+      b->pending = false;
+    }
+}
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -75,13 +146,14 @@ fsutil_extract (char **argv UNUSED)
   static block_sector_t sector = 0;
 
   struct block *src;
-  void *header, *data;
+  void *header;
+  struct batch batches[2];
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
+  if (header == NULL)
     PANIC ("couldn't allocate buffers");
+  batches_init (batches);
 
   /* Open source block device. */
   src = block_get_role (BLOCK_SCRATCH);
@@ -124,18 +196,42 @@ fsutil_extract (char **argv UNUSED)
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
-          while (size > 0)
-            {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
-              if (file_write (dst, data, chunk_size) != chunk_size)
-                PANIC ("%s: write failed with %d bytes unwritten",
-                       file_name, size);
-              size -= chunk_size;
-            }
+          /* Do copy.  Read the next batch while writing this one. */
+          {
+            size_t left = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+            int cur = 0;
+
+            while (size > 0)
+              {
+                struct batch *b = &batches[cur];
+                int chunk_size;
+
+                if (!b->pending)
+                  {
+                    size_t cnt = left < BATCH_SECTORS ? left : BATCH_SECTORS;
+                    batch_submit (src, b, sector, cnt, false);
+                    sector += cnt;
+                    left -= cnt;
+                  }
+                if (left > 0)
+                  {
+                    size_t cnt = left < BATCH_SECTORS ? left : BATCH_SECTORS;
+                    batch_submit (src, &batches[!cur], sector, cnt, false);
+                    sector += cnt;
+                    left -= cnt;
+                  }
+                batch_wait (b);
+
+                chunk_size = b->sector_cnt * BLOCK_SECTOR_SIZE;
+                if (chunk_size > size)
+                  chunk_size = size;
+                if (file_write (dst, b->data, chunk_size) != chunk_size)
+                  PANIC ("%s: write failed with %d bytes unwritten",
+                         file_name, size);
+                size -= chunk_size;
+                cur = !cur;
+              }
+          }
 
           /* Finish up. */
           file_close (dst);
@@ -151,7 +247,7 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
+  batches_done (batches);
   free (header);
 }
 
@@ -173,6 +269,8 @@ fsutil_append (char **argv)
   struct file *src;
   struct block *dst;
   off_t size;
+  struct batch batches[2];
+  int cur = 0;
 
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
@@ -197,18 +295,33 @@ fsutil_append (char **argv)
     PANIC ("%s: name too long for ustar format", file_name);
   block_write (dst, sector++, buffer);
 
-  /* Do copy. */
+  /* Do copy.  Fill one batch from the file while the other is
+     being written. */
+  batches_init (batches);
   while (size > 0) 
     {
-      int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
+      struct batch *b = &batches[cur];
+      size_t cnt = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+      int chunk_size;
+
+      if (cnt > BATCH_SECTORS)
+        cnt = BATCH_SECTORS;
+      chunk_size = cnt * BLOCK_SECTOR_SIZE;
+      if (chunk_size > size)
+        chunk_size = size;
+      if (sector + cnt > block_size (dst))
         PANIC ("%s: out of space on scratch device", file_name);
-      if (file_read (src, buffer, chunk_size) != chunk_size)
+
+      batch_wait (b);
+      if (file_read (src, b->data, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
+      memset (b->data + chunk_size, 0, cnt * BLOCK_SECTOR_SIZE - chunk_size);
+      batch_submit (dst, b, sector, cnt, true);
+      sector += cnt;
       size -= chunk_size;
+      cur = !cur;
     }
+  batches_done (batches);
 
   /* Write ustar end-of-archive marker, which is two consecutive
      sectors full of zeros.  Don't advance our position past
@@ -1,23 +1,52 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#ifdef USERPROG
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#else
+struct frame;
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* inode_disk의 direct 포인터 수와 인덱스 블록 하나에 들어가는 포인터
+   수입니다. 포인터가 0이면 아직 할당되지 않은 구간(hole)입니다. 0번
+   섹터는 free map의 inode이므로 데이터 섹터가 될 수 없습니다. */
+#define DIRECT_CNT 124
+#define PTRS_PER_SECTOR ((size_t) (BLOCK_SECTOR_SIZE / sizeof (block_sector_t)))
+
+/* 한 파일이 가질 수 있는 최대 섹터 수와 길이입니다. */
+#define INODE_MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                           + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+#define INODE_MAX_LENGTH ((off_t) (INODE_MAX_SECTORS * BLOCK_SECTOR_SIZE))
+
+/* inode_read_at()이 캐시를 거치지 않고 cache_read_range()로 한 번에 읽는
+   가장 짧은 연속 구간의 섹터 수입니다. */
+#define RANGE_READ_MIN 8
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+/* 데이터 섹터는 direct, indirect, doubly indirect 포인터로 찾습니다. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    block_sector_t direct[DIRECT_CNT];  /* Data sectors. */
+    block_sector_t indirect;            /* Block of data sector pointers. */
+    block_sector_t doubly_indirect;     /* Block of indirect pointers. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,40 +57,220 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* open_inodes에서 inode를 찾는 키입니다. 찾을 때는 이것만 스택에
+   만들면 되도록 struct inode와 따로 정의합니다. */
+struct inode_key
+  {
+    struct hash_elem elem;              /* Element in open_inodes. */
+    block_sector_t sector;              /* Sector number of disk location. */
+  };
+
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
-    block_sector_t sector;              /* Sector number of disk location. */
+    struct inode_key key;               /* Hash element and sector. */
+    bool loading;                       /* Still being read from disk? */
+    struct condition loaded;            /* Signaled when loading ends. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    off_t next_read_ofs;                /* Where a sequential read resumes. */
+    struct lock lock;                   /* Serializes growth. */
+    struct rwlock dir_lock;             /* Directory contents lock. */
+    bool meta;                          /* Journal data writes? */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* *GOAL에서 가장 가까운 뒤쪽의 새 섹터를 할당하고 0으로 채운 뒤
+   *SECTORP에 저장합니다. 다음 할당이 바로 뒤에 오도록 *GOAL은 새 섹터의
+   다음 섹터로 바꿉니다. 디스크가 가득 찼다면 false를 리턴하고 *SECTORP는
+   그대로 둡니다. META가 true면 0으로 채우는 쓰기도 저널을 거칩니다. */
+static bool
+allocate_zeroed (block_sector_t *sectorp, bool meta, block_sector_t *goal)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate_near (*goal, 1, sectorp))
+    return false;
+  *goal = *sectorp + 1;
+  if (meta)
+    cache_write_meta (*sectorp, zeros);
+  else
+    cache_write (*sectorp, zeros);
+  return true;
+}
+
+/* 메모리에 있는 포인터 *SLOT이 가리키는 섹터를 리턴합니다. 비어 있고
+   GOAL이 널이 아니라면 새로 할당하고 *CHANGED를 true로 만듭니다. 할당하지
+   못했거나 hole이라면 0을 리턴합니다. META와 GOAL은 allocate_zeroed()와
+   같습니다. */
+static block_sector_t
+index_slot (block_sector_t *slot, bool meta, block_sector_t *goal,
+            bool *changed)
+{
+  if (*slot == 0 && goal != NULL && allocate_zeroed (slot, meta, goal))
+    *changed = true;
+  return *slot;
+}
+
+/* 인덱스 블록 BLOCK의 IDX번째 포인터가 가리키는 섹터를 리턴합니다.
+   비어 있고 GOAL이 널이 아니라면 새로 할당해서 BLOCK에 기록합니다. META와
+   GOAL은 allocate_zeroed()와 같고, BLOCK에 기록하는 쓰기는 항상 저널을
+   거칩니다. */
+static block_sector_t
+index_block_slot (block_sector_t block, size_t idx, bool meta,
+                  block_sector_t *goal)
+{
+  block_sector_t sector;
+
+  cache_read_at (block, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == 0 && goal != NULL && allocate_zeroed (&sector, meta, goal))
+    cache_write_meta_at (block, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* DISK 파일의 IDX번째 데이터 섹터를 리턴합니다. GOAL이 널이 아니라면 가는
+   길에 비어 있는 인덱스 블록과 데이터 섹터를 *GOAL부터 차례로 할당하고,
+   DISK 자체가 바뀌면 *CHANGED를 true로 만듭니다. hole이거나 할당에
+   실패하면 0을 리턴합니다. 인덱스 블록은 항상, 데이터 섹터는 META가
+   true일 때 저널을 거쳐서 0으로 채웁니다. */
+static block_sector_t
+index_lookup (struct inode_disk *disk, size_t idx, bool meta,
+              block_sector_t *goal, bool *changed)
+{
+  block_sector_t block;
+
+  if (idx < DIRECT_CNT)
+    return index_slot (&disk->direct[idx], meta, goal, changed);
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    {
+      block = index_slot (&disk->indirect, true, goal, changed);
+      return block != 0 ? index_block_slot (block, idx, meta, goal) : 0;
+    }
+  idx -= PTRS_PER_SECTOR;
+
+  if (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    {
+      block = index_slot (&disk->doubly_indirect, true, goal, changed);
+      if (block != 0)
+        block = index_block_slot (block, idx / PTRS_PER_SECTOR, true, goal);
+      return (block != 0
+              ? index_block_slot (block, idx % PTRS_PER_SECTOR, meta, goal)
+              : 0);
+    }
+  return 0;
+}
+
+/* SECTOR와, LEVEL이 1 이상이면 SECTOR가 가리키는 섹터들을 LEVEL-1 단계까지
+   모두 free map에 돌려줍니다. LEVEL 0은 데이터 섹터입니다. */
+static void
+release_index (block_sector_t sector, int level)
+{
+  size_t i;
+
+  if (sector == 0)
+    return;
+  if (level > 0)
+    for (i = 0; i < PTRS_PER_SECTOR; i++)
+      release_index (index_block_slot (sector, i, false, NULL), level - 1);
+  free_map_release (sector, 1);
+}
+
+/* *A와 *B를 맞바꿉니다. */
+static void
+swap_sector (block_sector_t *a, block_sector_t *b)
+{
+  block_sector_t t = *a;
+  *a = *b;
+  *b = t;
+}
+
+/* DISK가 가리키는 모든 데이터 섹터와 인덱스 블록을 돌려줍니다. */
+static void
+release_sectors (struct inode_disk *disk)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_index (disk->direct[i], 0);
+  release_index (disk->indirect, 1);
+  release_index (disk->doubly_indirect, 2);
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within INODE. */
+/* 파일 길이와 상관없이 POS가 속한 섹터를 찾습니다. 할당되지 않은 hole이면
+   0을 리턴합니다. CREATE가 true라면 필요한 섹터를 할당하고, 디스크가
+   가득 찼을 때만 0을 리턴합니다. 새 섹터는 파일의 바로 앞 섹터 뒤에,
+   앞 섹터가 없으면 inode 뒤에 두어 파일이 디스크에서도 연속되게
+   합니다. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos, bool create) 
 {
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t sector, goal;
+  bool changed = false;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
-    return -1;
+  ASSERT (pos >= 0);
+
+  if (pos >= INODE_MAX_LENGTH)
+    return 0;
+  if (!create)
+    return index_lookup (&inode->data, idx, false, NULL, &changed);
+
+  lock_acquire (&inode->lock);
+  goal = idx > 0 ? index_lookup (&inode->data, idx - 1, false, NULL,
+                                 &changed) : 0;
+  goal = goal != 0 ? goal + 1 : inode->key.sector + 1;
+  sector = index_lookup (&inode->data, idx, inode->meta, &goal, &changed);
+  if (changed)
+    cache_write_meta (inode->key.sector, &inode->data);
+  lock_release (&inode->lock);
+  return sector;
 }
 
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes;
+/* 섹터 번호로 찾는 해시 테이블입니다. open_inodes_lock은 테이블과 각
+   inode의 open_cnt, loading을 보호합니다. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+/* struct inode를 정확한 크기로 할당하는 slab 캐시입니다. */
+static struct kmem_cache *inode_cache;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("can't create open inode table");
+  lock_init (&open_inodes_lock);
+  inode_cache = kmem_cache_create (sizeof (struct inode), NULL);
+  if (inode_cache == NULL)
+    PANIC ("can't create inode cache");
+}
+
+/* open_inodes에서 키 E의 해시 값으로 섹터 번호를 씁니다. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode_key, elem)->sector);
+}
+
+/* open_inodes에서 키 A의 섹터 번호가 B보다 작으면 true를 리턴합니다. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode_key, elem)->sector
+          < hash_entry (b, struct inode_key, elem)->sector);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -81,26 +290,20 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  if (length > INODE_MAX_LENGTH)
+    return false;
+
+  /* 데이터 섹터는 미리 할당하지 않습니다. 파일 전체가 hole로 시작하므로
+     아직 쓰지 않은 섹터는 읽으면 0이 되고, 처음 쓸 때 할당됩니다. 길이와
+     상관없이 inode 섹터 하나만 씁니다. */
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      cache_write_meta (sector, disk_inode);
       free (disk_inode);
+      success = true;
     }
   return success;
 }
@@ -108,36 +311,60 @@ inode_create (block_sector_t sector, off_t length)
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
+/* 새 inode는 읽기 중(loading)으로 표시해 open_inodes에 먼저 넣고,
+   open_inodes_lock을 놓은 채로 디스크에서 읽습니다. 그동안 같은 섹터를
+   여는 스레드들은 같은 inode를 얻되 읽기가 끝날 때까지 loaded에서
+   기다립니다. 다른 섹터를 여닫는 스레드들은 기다리지 않습니다. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct hash_elem *e;
   struct inode *inode;
+  struct inode_key key;
+
+  lock_acquire (&open_inodes_lock);
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, key.elem);
+      inode->open_cnt++;
+      while (inode->loading)
+        cond_wait (&inode->loaded, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
-  inode->sector = sector;
+  inode->key.sector = sector;
+  inode->loading = true;
+  cond_init (&inode->loaded);
+  hash_insert (&open_inodes, &inode->key.elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->next_read_ofs = 0;
+  lock_init (&inode->lock);
+  rwlock_init (&inode->dir_lock);
+  inode->meta = false;
+  lock_release (&open_inodes_lock);
+
+  cache_read (inode->key.sector, &inode->data);
+
+  lock_acquire (&open_inodes_lock);
+  inode->loading = false;
+  cond_broadcast (&inode->loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +373,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -154,7 +385,7 @@ inode_reopen (struct inode *inode)
 block_sector_t
 inode_get_inumber (const struct inode *inode)
 {
-  return inode->sector;
+  return inode->key.sector;
 }
 
 /* Closes INODE and writes it to disk.
@@ -168,21 +399,67 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
       /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      hash_delete (&open_inodes, &inode->key.elem);
+      lock_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          free_map_release (inode->key.sector, 1);
+          release_sectors (&inode->data);
         }
 
-      free (inode); 
+      kmem_cache_free (inode_cache, inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
+}
+
+/* INODE의 데이터도 메타데이터로 다루어 저널을 거쳐서 쓰게 합니다.
+   디렉터리와 free map 파일에 씁니다. */
+void
+inode_set_metadata (struct inode *inode)
+{
+  inode->meta = true;
+}
+
+/* INODE가 디렉터리일 때 그 내용을 보호하는 rwlock을 리턴합니다. 같은
+   섹터를 연 모든 struct dir이 같은 rwlock을 씁니다. (directory.c) */
+struct rwlock *
+inode_dir_lock (struct inode *inode)
+{
+  return &inode->dir_lock;
+}
+
+/* A와 B의 길이와 데이터 섹터를 맞바꾸고 두 inode를 디스크에 씁니다.
+   디렉터리를 새 섹터들에 다 만든 뒤 한 번에 바꿔 넣을 때 씁니다. */
+void
+inode_exchange (struct inode *a, struct inode *b)
+{
+  struct inode *first = a->key.sector < b->key.sector ? a : b;
+  struct inode *second = first == a ? b : a;
+  off_t length;
+  size_t i;
+
+  lock_acquire (&first->lock);
+  lock_acquire (&second->lock);
+
+  length = a->data.length;
+  a->data.length = b->data.length;
+  b->data.length = length;
+  for (i = 0; i < DIRECT_CNT; i++)
+    swap_sector (&a->data.direct[i], &b->data.direct[i]);
+  swap_sector (&a->data.indirect, &b->data.indirect);
+  swap_sector (&a->data.doubly_indirect, &b->data.doubly_indirect);
+  cache_write_meta (a->key.sector, &a->data);
+  cache_write_meta (b->key.sector, &b->data);
+
+  lock_release (&second->lock);
+  lock_release (&first->lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -194,20 +471,81 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* 파일의 OFFSET 위치가 디스크의 SECTOR에 있을 때, 거기서부터 디스크에서도
+   연속으로 놓인 섹터가 몇 개인지 MAX_CNT개까지 셉니다. */
+static size_t
+contiguous_sectors (struct inode *inode, off_t offset, block_sector_t sector,
+                    size_t max_cnt)
+{
+  size_t cnt = 1;
+
+  while (cnt < max_cnt
+         && (byte_to_sector (inode, offset + cnt * BLOCK_SECTOR_SIZE, false)
+             == sector + cnt))
+    cnt++;
+  return cnt;
+}
+
+/* 디스크가 BUFFER에 직접 읽어 넣을 수 있는 커널 주소를 리턴하고, 그
+   주소부터 연속으로 읽을 수 있는 섹터 수로 *MAX_CNT를 줄입니다.
+
+   디스크 I/O는 I/O 스레드에서 일어나므로 사용자 주소를 그대로 넘길 수
+   없습니다. 사용자 버퍼라면 현재 프로세스의 페이지 디렉터리에서 그
+   페이지가 매핑된 커널 주소를 찾고, 페이지 끝까지만 읽게 합니다. 섹터가
+   페이지 경계에 걸치거나, 페이지가 없거나 쓸 수 없다면 null pointer를
+   리턴하고, 호출자는 버퍼 캐시를 거쳐 복사합니다.
+
+   VM에서는 읽는 동안 그 프레임이 쫓겨나지 않도록 pin해서 *FRAMEP에
+   저장하므로, 호출자는 읽기가 끝나면 frame_unpin()으로 풀어야 합니다.
+   디스크가 커널 주소로 쓰면 사용자 페이지의 dirty 비트가 켜지지 않으므로
+   여기서 켜 둡니다. 그러지 않으면 깨끗한 페이지로 보고 버립니다. */
+static uint8_t *
+direct_buffer (uint8_t *buffer, size_t *max_cnt, struct frame **framep)
+{
+  *framep = NULL;
+#ifdef USERPROG
+  if (is_user_vaddr (buffer))
+    {
+      uint32_t *pd = thread_current ()->pagedir;
+      size_t page_cnt = (PGSIZE - pg_ofs (buffer)) / BLOCK_SECTOR_SIZE;
+
+      if (pd == NULL || pg_ofs (buffer) % BLOCK_SECTOR_SIZE != 0
+          || !pagedir_is_writable (pd, buffer))
+        return NULL;
+#ifdef VM
+      *framep = frame_pin (pg_round_down (buffer));
+      if (*framep == NULL)
+        return NULL;
+      pagedir_set_dirty (pd, buffer, true);
+#endif
+      if (*max_cnt > page_cnt)
+        *max_cnt = page_cnt;
+      return pagedir_get_page (pd, buffer);
+    }
+#endif
+  return buffer;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
+/* 섹터는 버퍼 캐시를 거쳐서 읽고, 할당되지 않은 hole은 0으로 채웁니다.
+   디스크에서도 연속된 RANGE_READ_MIN개 이상의 섹터를 통째로 읽을 때는
+   cache_read_range()로 버퍼에 바로 읽어 넣습니다. 사용자 버퍼라면
+   direct_buffer()가 찾은 페이지에 복사 없이 읽습니다. 이전 읽기가 끝난
+   곳에서 이어서 읽는 순차 접근이라면 다음 섹터를 미리 읽어 두도록
+   요청합니다. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  bool sequential = offset == inode->next_read_ofs;
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, false);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -215,104 +553,127 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
+      /* 읽어야 할 남은 바이트 중 통째로 읽을 수 있는 섹터 수입니다. */
+      size_t whole_sectors = ((size < inode_left ? size : inode_left)
+                              / BLOCK_SECTOR_SIZE);
+
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
+      /* 섹터 경계에서 시작해 여러 섹터를 통째로 읽는 경우, 디스크에서도
+         연속된 섹터들을 한 번에 읽습니다. */
+      if (sector_idx != 0 && sector_ofs == 0
+          && whole_sectors >= RANGE_READ_MIN)
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
+          struct frame *frame;
+          uint8_t *direct = direct_buffer (buffer + bytes_read,
+                                           &whole_sectors, &frame);
+          size_t run = (direct != NULL && whole_sectors >= RANGE_READ_MIN
+                        ? contiguous_sectors (inode, offset, sector_idx,
+                                              whole_sectors)
+                        : 0);
+          if (run >= RANGE_READ_MIN)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              cache_read_range (sector_idx, run, direct);
+              chunk_size = run * BLOCK_SECTOR_SIZE;
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+#ifdef VM
+          if (frame != NULL)
+            frame_unpin (frame);
+#endif
+          if (run < RANGE_READ_MIN)
+            cache_read (sector_idx, buffer + bytes_read);
         }
+      else if (sector_idx != 0)
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  if (sequential && bytes_read > 0)
+    {
+      off_t next_ofs = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+      block_sector_t next = (next_ofs < inode_length (inode)
+                             ? byte_to_sector (inode, next_ofs, false) : 0);
+      if (next != 0)
+        cache_read_ahead (next);
+    }
+  inode->next_read_ofs = offset;
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs. */
+/* 파일 끝을 넘어서 쓰면 파일이 늘어납니다. 쓰는 섹터만 할당하므로 그 사이의
+   구간은 hole로 남고, 디스크가 가득 차서 할당에 실패하면 거기서 멈춥니다. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
+  if (offset >= INODE_MAX_LENGTH)
+    return 0;
+  if (size > INODE_MAX_LENGTH - offset)
+    size = INODE_MAX_LENGTH - offset;
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in sector. */
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
+      int chunk_size = size < sector_left ? size : sector_left;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+      sector_idx = byte_to_sector (inode, offset, true);
+      if (sector_idx == 0)
+        break;
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* The cache reads the sector in first only if the chunk
+         doesn't cover all of it. */
+      if (inode->meta)
+        cache_write_meta_at (sector_idx, buffer + bytes_written, sector_ofs,
+                             chunk_size);
+      else
+        cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+                        chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* 데이터를 다 쓴 뒤에 길이를 늘립니다. */
+  if (offset > inode->data.length)
+    {
+      lock_acquire (&inode->lock);
+      if (offset > inode->data.length)
+        {
+          inode->data.length = offset;
+          cache_write_meta (inode->key.sector, &inode->data);
+        }
+      lock_release (&inode->lock);
+    }
 
   return bytes_written;
 }
@@ -0,0 +1,442 @@
+#include "filesys/journal.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* 메타데이터 섹터(inode, 인덱스 블록, 디렉터리, free map)를 위한
+   write-ahead 로그입니다.
+
+   메타데이터를 바꾸는 작업은 journal_begin()과 journal_end() 사이에서
+   실행됩니다. 작업 중에 버퍼 캐시에 쓰인 메타데이터 섹터는 journal_add()로
+   현재 트랜잭션에 들어가고, 커밋될 때까지 캐시에 묶여 제자리에 쓰이지
+   않습니다. 트랜잭션은 write-behind 스레드가 주기적으로, 또는 트랜잭션이
+   가득 찼을 때 진행 중인 작업이 모두 끝나기를 기다렸다가 한꺼번에
+   커밋합니다(group commit).
+
+   커밋은 섹터 내용을 로그에 연속으로 쓴 다음, 어느 섹터들인지 적은
+   descriptor를 그 앞 섹터에 씁니다. descriptor가 디스크에 쓰인 순간이
+   커밋 시점입니다. 이후 섹터들은 캐시의 write-behind가 평소처럼 제자리에
+   씁니다. 로그에 트랜잭션 하나가 더 들어갈 자리가 없으면 커밋이 끝난
+   직후에 캐시의 dirty 섹터를 모두 제자리에 쓰고(checkpoint) 로그를
+   처음부터 다시 씁니다. 이때는 묶여 있는 섹터가 없으므로 커밋된 내용은
+   모두 캐시나 디스크에 있습니다.
+
+   마운트할 때는 헤더에 적힌 순서 번호부터 이어지는 트랜잭션들을 로그에서
+   찾아 제자리에 다시 씁니다.
+
+   로그에 사본이 있는 섹터가 해제되면 현재 트랜잭션에 revoke를 남깁니다.
+   그 섹터가 데이터 블록으로 재사용되어 로그 없이 쓰인 뒤에 시스템이
+   멈추더라도, 다시 쓸 때 revoke가 든 트랜잭션과 그 이전의 사본은
+   건너뛰므로 예전 메타데이터로 덮어쓰지 않습니다. 같은 트랜잭션에서 다시
+   메타데이터로 쓰이면 revoke를 지웁니다.
+
+   작업 하나는 OP_SECTORS개 이하의 섹터만 바꿔야 합니다. 큰 파일
+   쓰기는 file.c가 여러 작업으로 나누고, 디렉터리를 늘릴 때는 새 테이블을
+   로그 없이 써서 디스크에 내린 뒤 inode만 저널을 거쳐 바꿉니다. */
+
+#define JOURNAL_MAGIC 0x4c4e524a        /* Identifies journal sectors. */
+#define LOG_START (JOURNAL_SECTOR + 1)  /* First log sector. */
+#define LOG_END (LOG_START + JOURNAL_LOG_CNT) /* Past the last log sector. */
+#define TXN_MAX 32                      /* Max sectors per transaction. */
+#define OP_SECTORS 8                    /* Sectors reserved per operation. */
+#define OP_LIMIT (TXN_MAX - 8)          /* Sectors that operations may use;
+                                           the rest are for the free map. */
+
+/* Journal header, in JOURNAL_SECTOR. */
+struct journal_header
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Sequence number at LOG_START. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8];
+  };
+
+/* Revokes that fit in a descriptor, and revokes that the running
+   transaction may collect: one per sector with a copy in the log
+   or in the transaction. */
+#define REVOKE_MAX ((BLOCK_SECTOR_SIZE - 16) / sizeof (block_sector_t) \
+                    - TXN_MAX)
+#define REVOKE_SLOTS (JOURNAL_LOG_CNT + TXN_MAX)
+
+/* Transaction descriptor, the first log sector of a transaction.
+   The CNT sectors after it hold the new contents of SECTORS.
+   Copies of REVOKED in this and earlier transactions are stale. */
+struct journal_desc
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    uint32_t revoke_cnt;                /* Number of revoked sectors. */
+    block_sector_t sectors[TXN_MAX];    /* Home locations. */
+    block_sector_t revoked[REVOKE_MAX]; /* Freed home locations. */
+  };
+
+/* journal_lock은 아래의 현재 트랜잭션과 작업 상태를 보호합니다. */
+static struct lock journal_lock;
+static struct condition journal_changed; /* Commit ended or op ended. */
+static block_sector_t txn[TXN_MAX];     /* Sectors in running transaction. */
+static size_t txn_cnt;                  /* Number of sectors in TXN. */
+static int outstanding;                 /* Operations in progress. */
+static bool committing;                 /* Commit in progress? */
+static struct thread *committer;        /* Thread doing the commit. */
+static struct bitmap *logged;           /* Sectors with a copy in the log. */
+static block_sector_t revoked[REVOKE_SLOTS]; /* Revokes in running txn. */
+static size_t revoke_cnt;               /* Number of sectors in REVOKED. */
+
+/* 로그 상태입니다. 커밋하는 스레드만 바꿉니다. */
+static block_sector_t log_head;         /* Where the next transaction goes. */
+static uint32_t log_start_seq;          /* Sequence number at LOG_START. */
+static uint32_t log_seq;                /* Next transaction's number. */
+static uint8_t *txn_data;               /* TXN_MAX sectors of data. */
+
+static void reset_log (void);
+static bool in_txn (block_sector_t);
+static void write_txn (const block_sector_t *, size_t cnt,
+                       const block_sector_t *revokes, size_t revoke_cnt);
+static void checkpoint (void);
+static uint32_t install_log (uint32_t seq);
+
+/* 저널을 초기화합니다. FORMAT이 true면 로그를 비우고, 아니면 로그에 남은
+   커밋된 트랜잭션들을 제자리에 다시 씁니다. 버퍼 캐시를 쓰지 않으므로
+   cache_init()보다 먼저 불러야 합니다. */
+void
+journal_init (bool format)
+{
+  struct journal_header h;
+  size_t pages = DIV_ROUND_UP (TXN_MAX * BLOCK_SECTOR_SIZE, PGSIZE);
+
+  ASSERT (sizeof (struct journal_header) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_desc) == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&journal_changed);
+  txn_cnt = 0;
+  outstanding = 0;
+  committing = false;
+  committer = NULL;
+  revoke_cnt = 0;
+  logged = bitmap_create (block_size (fs_device));
+  if (logged == NULL)
+    PANIC ("can't create journal bitmap");
+  txn_data = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, pages);
+
+  block_read (fs_device, JOURNAL_SECTOR, &h);
+  log_seq = h.magic == JOURNAL_MAGIC ? h.seq : 0;
+  if (format)
+    {
+      /* 예전 descriptor가 새 트랜잭션으로 보이지 않도록 로그를 지웁니다. */
+      block_sector_t sector;
+      for (sector = LOG_START; sector < LOG_END; sector += TXN_MAX)
+        block_write_range (fs_device, sector,
+                           LOG_END - sector < TXN_MAX
+                           ? LOG_END - sector : TXN_MAX, txn_data);
+    }
+  else if (h.magic == JOURNAL_MAGIC)
+    {
+      uint32_t end_seq = install_log (log_seq);
+      if (end_seq != log_seq)
+        printf ("journal: replayed %"PRIu32" transactions\n",
+                end_seq - log_seq);
+      log_seq = end_seq;
+    }
+  reset_log ();
+}
+
+/* 남은 트랜잭션을 커밋하고 캐시를 모두 디스크에 쓴 뒤 로그를 비웁니다. */
+void
+journal_done (void)
+{
+  journal_commit ();
+  checkpoint ();
+}
+
+/* 메타데이터를 바꾸는 작업을 시작합니다. 현재 트랜잭션에 작업 하나가 쓸
+   OP_SECTORS개의 자리가 남을 때까지, 그리고 커밋 중이면 커밋이 끝날
+   때까지 기다립니다. */
+void
+journal_begin (void)
+{
+  if (committer == thread_current ())
+    return;
+
+  lock_acquire (&journal_lock);
+  for (;;)
+    {
+      if (committing)
+        cond_wait (&journal_changed, &journal_lock);
+      else if (txn_cnt + (outstanding + 1) * OP_SECTORS <= OP_LIMIT)
+        break;
+      else if (outstanding == 0)
+        {
+          lock_release (&journal_lock);
+          journal_commit ();
+          lock_acquire (&journal_lock);
+        }
+      else
+        cond_wait (&journal_changed, &journal_lock);
+    }
+  outstanding++;
+  lock_release (&journal_lock);
+}
+
+/* journal_begin()으로 시작한 작업을 끝냅니다. 마지막 작업이 끝났는데
+   트랜잭션에 다른 작업이 들어갈 자리가 없으면 바로 커밋합니다. */
+void
+journal_end (void)
+{
+  bool full;
+
+  if (committer == thread_current ())
+    return;
+
+  lock_acquire (&journal_lock);
+  ASSERT (outstanding > 0);
+  outstanding--;
+  full = outstanding == 0 && txn_cnt + OP_SECTORS > OP_LIMIT;
+  cond_broadcast (&journal_changed, &journal_lock);
+  lock_release (&journal_lock);
+
+  if (full)
+    journal_commit ();
+}
+
+/* 진행 중인 작업이 모두 끝나기를 기다렸다가 현재 트랜잭션을 커밋합니다.
+   미뤄 둔 free map 변경도 같은 트랜잭션에 넣습니다. revoke가 descriptor에
+   다 들어가지 않으면 먼저 checkpoint해서 로그를 비웁니다. 그러면 현재
+   트랜잭션에 든 섹터의 revoke만 남습니다. */
+void
+journal_commit (void)
+{
+  static block_sector_t sectors[TXN_MAX];    /* 커밋하는 스레드만 씁니다. */
+  static block_sector_t revokes[REVOKE_MAX];
+  size_t cnt, revokes_cnt, i;
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&journal_changed, &journal_lock);
+  committing = true;
+  while (outstanding > 0)
+    cond_wait (&journal_changed, &journal_lock);
+  committer = thread_current ();
+  lock_release (&journal_lock);
+
+  free_map_flush ();
+
+  lock_acquire (&journal_lock);
+  if (revoke_cnt > REVOKE_MAX)
+    {
+      lock_release (&journal_lock);
+      checkpoint ();
+      lock_acquire (&journal_lock);
+    }
+  ASSERT (revoke_cnt <= REVOKE_MAX);
+  cnt = txn_cnt;
+  memcpy (sectors, txn, cnt * sizeof *sectors);
+  for (i = 0; i < cnt; i++)
+    bitmap_mark (logged, sectors[i]);
+  txn_cnt = 0;
+  revokes_cnt = revoke_cnt;
+  memcpy (revokes, revoked, revokes_cnt * sizeof *revokes);
+  revoke_cnt = 0;
+  lock_release (&journal_lock);
+
+  if (cnt > 0 || revokes_cnt > 0)
+    write_txn (sectors, cnt, revokes, revokes_cnt);
+
+  lock_acquire (&journal_lock);
+  committer = NULL;
+  committing = false;
+  cond_broadcast (&journal_changed, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* 캐시에 방금 쓰인 메타데이터 SECTOR를 현재 트랜잭션에 넣고 true를
+   리턴합니다. 이미 들어 있어도 true입니다. 해제된 뒤 다시 메타데이터로
+   쓰인 것이므로 SECTOR의 revoke는 지웁니다. 트랜잭션이 가득 찼다면
+   false를 리턴하고, 그 섹터는 로그 없이 쓰입니다. */
+bool
+journal_add (block_sector_t sector)
+{
+  bool added;
+  size_t i;
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < revoke_cnt; i++)
+    if (revoked[i] == sector)
+      {
+        revoked[i] = revoked[--revoke_cnt];
+        break;
+      }
+  added = in_txn (sector) || txn_cnt < TXN_MAX;
+  if (added && !in_txn (sector))
+    txn[txn_cnt++] = sector;
+  lock_release (&journal_lock);
+  return added;
+}
+
+/* 해제된 SECTOR에 로그나 현재 트랜잭션에 든 사본이 있으면 현재
+   트랜잭션에 revoke를 남깁니다. free_map_release()가 부릅니다. */
+void
+journal_revoke (block_sector_t sector)
+{
+  size_t i;
+
+  lock_acquire (&journal_lock);
+  if (bitmap_test (logged, sector) || in_txn (sector))
+    {
+      bitmap_reset (logged, sector);
+      for (i = 0; i < revoke_cnt; i++)
+        if (revoked[i] == sector)
+          break;
+      if (i == revoke_cnt)
+        {
+          ASSERT (revoke_cnt < REVOKE_SLOTS);
+          revoked[revoke_cnt++] = sector;
+        }
+    }
+  lock_release (&journal_lock);
+}
+
+/* SECTOR가 현재 트랜잭션에 들어 있으면 true를 리턴합니다. journal_lock을
+   잡고 호출해야 합니다. */
+static bool
+in_txn (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+
+  for (i = 0; i < txn_cnt; i++)
+    if (txn[i] == sector)
+      return true;
+  return false;
+}
+
+/* 로그를 비우고 새 시작 순서 번호를 헤더에 씁니다. 로그에 남은 사본이
+   없으므로 현재 트랜잭션에 든 섹터의 revoke만 남깁니다. */
+static void
+reset_log (void)
+{
+  static struct journal_header h;
+  size_t i, j;
+
+  lock_acquire (&journal_lock);
+  bitmap_set_all (logged, false);
+  for (i = j = 0; i < revoke_cnt; i++)
+    if (in_txn (revoked[i]))
+      revoked[j++] = revoked[i];
+  revoke_cnt = j;
+  lock_release (&journal_lock);
+
+  log_head = LOG_START;
+  log_start_seq = log_seq;
+  h.magic = JOURNAL_MAGIC;
+  h.seq = log_start_seq;
+  block_write (fs_device, JOURNAL_SECTOR, &h);
+}
+
+/* SECTORS의 CNT개 섹터와 REVOKES의 REVOKE_CNT개 revoke를 한
+   트랜잭션으로 로그에 씁니다. 섹터 내용을 먼저 쓰고, 모두 디스크에
+   쓰인 뒤에 descriptor를 씁니다. 다음 트랜잭션이 들어갈 자리가 남지
+   않으면 checkpoint합니다. 커밋하는 스레드만 부릅니다. */
+static void
+write_txn (const block_sector_t *sectors, size_t cnt,
+           const block_sector_t *revokes, size_t revoke_cnt)
+{
+  static struct journal_desc d;
+  size_t i;
+
+  ASSERT (cnt <= TXN_MAX && revoke_cnt <= REVOKE_MAX);
+  ASSERT (log_head + 1 + cnt <= LOG_END);
+
+  for (i = 0; i < cnt; i++)
+    cache_log_copy (sectors[i], txn_data + i * BLOCK_SECTOR_SIZE);
+  if (cnt > 0)
+    block_write_range (fs_device, log_head + 1, cnt, txn_data);
+
+  d.magic = JOURNAL_MAGIC;
+  d.seq = log_seq;
+  d.cnt = cnt;
+  d.revoke_cnt = revoke_cnt;
+  memcpy (d.sectors, sectors, cnt * sizeof *sectors);
+  memcpy (d.revoked, revokes, revoke_cnt * sizeof *revokes);
+  block_write (fs_device, log_head, &d);
+
+  for (i = 0; i < cnt; i++)
+    cache_log_done (sectors[i]);
+  log_head += 1 + cnt;
+  log_seq++;
+
+  if (log_head + 1 + TXN_MAX > LOG_END)
+    checkpoint ();
+}
+
+/* 커밋된 섹터들을 캐시에서 모두 제자리에 쓰고 로그를 비웁니다. 커밋
+   중이거나 작업이 모두 끝난 뒤에만 부를 수 있습니다. 로그를 다시 읽지
+   않으므로, 해제된 뒤 데이터 블록으로 재사용된 섹터를 예전 메타데이터로
+   덮어쓰지 않습니다. */
+static void
+checkpoint (void)
+{
+  cache_flush ();
+  reset_log ();
+}
+
+/* LOG_START부터 SEQ, SEQ + 1, ... 번 트랜잭션을 차례로 읽어, 각 섹터가
+   마지막으로 커밋된 내용을 제자리에 씁니다. 마지막 사본보다 나중이나 같은
+   트랜잭션에서 revoke된 섹터는 쓰지 않습니다. 같은 섹터를 여러 번 쓰지
+   않으므로 도중에 캐시가 그 섹터를 읽어도 예전 내용을 보지 않습니다.
+   찾은 마지막 트랜잭션 다음의 순서 번호를 리턴합니다. */
+static uint32_t
+install_log (uint32_t seq)
+{
+  static struct journal_desc d;
+  static block_sector_t homes[JOURNAL_LOG_CNT];
+  static block_sector_t copies[JOURNAL_LOG_CNT];
+  static uint8_t buffer[BLOCK_SECTOR_SIZE];
+  block_sector_t pos = LOG_START;
+  size_t cnt = 0;
+  size_t i, j;
+
+  while (pos < LOG_END)
+    {
+      block_read (fs_device, pos, &d);
+      if (d.magic != JOURNAL_MAGIC || d.seq != seq
+          || d.cnt > TXN_MAX || d.revoke_cnt > REVOKE_MAX
+          || d.cnt + d.revoke_cnt == 0 || pos + 1 + d.cnt > LOG_END)
+        break;
+
+      for (i = 0; i < d.cnt; i++)
+        {
+          for (j = 0; j < cnt; j++)
+            if (homes[j] == d.sectors[i])
+              break;
+          if (j == cnt)
+            homes[cnt++] = d.sectors[i];
+          copies[j] = pos + 1 + i;
+        }
+      /* 0번 섹터는 로그에 없으므로 사본이 없다는 뜻으로 씁니다. */
+      for (i = 0; i < d.revoke_cnt; i++)
+        for (j = 0; j < cnt; j++)
+          if (homes[j] == d.revoked[i])
+            copies[j] = 0;
+      pos += 1 + d.cnt;
+      seq++;
+    }
+
+  for (j = 0; j < cnt; j++)
+    if (copies[j] != 0)
+      {
+        block_read (fs_device, copies[j], buffer);
+        block_write (fs_device, homes[j], buffer);
+      }
+  return seq;
+}
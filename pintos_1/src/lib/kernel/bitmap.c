@@ -21,13 +21,25 @@ typedef unsigned long elem_type;
 /* Number of bits in an element. */
 #define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
 
+/* Bitmaps with at least this many elements keep a summary. */
+#define SUMMARY_MIN_ELEMS 32
+
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   Large bitmaps also keep a summary with one bit per element of
+   BITS, set when that element has at least one bit that is
+   false.  Searches for false bits, such as free pages or
+   sectors, use it to skip runs of full elements.  Like the bits
+   themselves, the summary is updated atomically with respect to
+   each change but not with respect to testing bits, so callers
+   that share a bitmap between threads must lock it. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *summary; /* Elements with a false bit, or null. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -68,6 +80,59 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the number of summary bytes for a bitmap of BIT_CNT
+   bits, which is 0 if it is too small to keep a summary. */
+static inline size_t
+summary_byte_cnt (size_t bit_cnt)
+{
+  size_t cnt = elem_cnt (bit_cnt);
+  return cnt >= SUMMARY_MIN_ELEMS ? byte_cnt (cnt) : 0;
+}
+
+/* Returns an elem_type with the CNT bits starting at bit OFS
+   set, where OFS + CNT <= ELEM_BITS. */
+static inline elem_type
+range_mask (size_t ofs, size_t cnt)
+{
+  elem_type mask = (cnt < ELEM_BITS
+                    ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1);
+  return mask << ofs;
+}
+
+/* Returns the number of bits set in X. */
+static inline size_t
+count_ones (elem_type x)
+{
+  size_t cnt = 0;
+
+  for (; x != 0; x &= x - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Returns the index of the lowest set bit in X, which must not
+   be 0. */
+static inline size_t
+lowest_one (elem_type x)
+{
+  return __builtin_ctzl (x);
+}
+
+/* Brings the summary bit for element IDX of B up to date. */
+static inline void
+update_summary (struct bitmap *b, size_t idx)
+{
+  elem_type valid;
+
+  if (b->summary == NULL)
+    return;
+  valid = idx == elem_cnt (b->bit_cnt) - 1 ? last_mask (b) : (elem_type) -1;
+  if ((b->bits[idx] & valid) != valid)
+    b->summary[elem_idx (idx)] |= bit_mask (idx);
+  else
+    b->summary[elem_idx (idx)] &= ~bit_mask (idx);
+}
 
 /* Creation and destruction. */
 
@@ -81,13 +146,19 @@ bitmap_create (size_t bit_cnt)
   struct bitmap *b = malloc (sizeof *b);
   if (b != NULL)
     {
+      size_t summary_size = summary_byte_cnt (bit_cnt);
+
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
-      if (b->bits != NULL || bit_cnt == 0)
+      b->summary = summary_size > 0 ? malloc (summary_size) : NULL;
+      if ((b->bits != NULL || bit_cnt == 0)
+          && (b->summary != NULL || summary_size == 0))
         {
           bitmap_set_all (b, false);
           return b;
         }
+      free (b->summary);
+      free (b->bits);
       free (b);
     }
   return NULL;
@@ -105,6 +176,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->summary = (summary_byte_cnt (bit_cnt) > 0
+                ? b->bits + elem_cnt (bit_cnt) : NULL);
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +187,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + byte_cnt (bit_cnt)
+         + summary_byte_cnt (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -125,6 +199,7 @@ bitmap_destroy (struct bitmap *b)
 {
   if (b != NULL) 
     {
+      free (b->summary);
       free (b->bits);
       free (b);
     }
@@ -164,6 +239,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -177,6 +253,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -192,6 +269,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -214,18 +292,32 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, a whole element at a
+   time. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+      elem_type mask = range_mask (ofs, n);
+
+      if (value)
+        asm ("orl %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "+m" (b->bits[idx]) : "r" (~mask) : "cc");
+      update_summary (b, idx);
+      start += n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,16 +325,23 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end)
+    {
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+      elem_type x = b->bits[elem_idx (start)];
+
+      value_cnt += count_ones ((value ? x : ~x) & range_mask (ofs, n));
+      start += n;
+    }
   return value_cnt;
 }
 
@@ -251,15 +350,22 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
+  while (start < end)
+    {
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+      elem_type x = b->bits[elem_idx (start)];
+
+      if (((value ? x : ~x) & range_mask (ofs, n)) != 0)
+        return true;
+      start += n;
+    }
   return false;
 }
 
@@ -289,6 +395,59 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Returns the index of the first element at or after IDX, and
+   before END, that has a false bit according to B's summary, or
+   END if there is none. */
+static size_t
+next_nonfull_elem (const struct bitmap *b, size_t idx, size_t end)
+{
+  while (idx < end)
+    {
+      elem_type x = b->summary[elem_idx (idx)] & ~(bit_mask (idx) - 1);
+
+      if (x != 0)
+        {
+          idx = elem_idx (idx) * ELEM_BITS + lowest_one (x);
+          return idx < end ? idx : end;
+        }
+      idx = (elem_idx (idx) + 1) * ELEM_BITS;
+    }
+  return end;
+}
+
+/* Returns the index of the first bit in B at or after START, and
+   before END, that is set to VALUE, or END if there is none.
+   Examines a whole element at a time, and skips full elements
+   through the summary when looking for false bits. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  size_t idx, end_idx;
+  elem_type x;
+
+  if (start >= end)
+    return end;
+
+  idx = elem_idx (start);
+  end_idx = elem_idx (end - 1) + 1;
+  x = (value ? b->bits[idx] : ~b->bits[idx]) & ~(bit_mask (start) - 1);
+  while (x == 0)
+    {
+      if (++idx >= end_idx)
+        return end;
+      if (!value && b->summary != NULL)
+        {
+          idx = next_nonfull_elem (b, idx, end_idx);
+          if (idx >= end_idx)
+            return end;
+        }
+      x = value ? b->bits[idx] : ~b->bits[idx];
+    }
+
+  start = idx * ELEM_BITS + lowest_one (x);
+  return start < end ? start : end;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -299,17 +458,52 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Jump to the next bit that could start a group, then to
+         the first bit that ends it early, if any. */
+      while (i <= last)
+        {
+          size_t end;
+
+          i = find_next (b, i, last + 1, value);
+          if (i > last)
+            break;
+          end = find_next (b, i, i + cnt, !value);
+          if (end == i + cnt)
+            return i;
+          i = end;
+        }
     }
   return BITMAP_ERROR;
 }
 
+/* Finds a group of CNT consecutive bits in B that are all set to
+   VALUE, preferring the first one at or after GOAL and otherwise
+   wrapping around to the first one in B, and returns its
+   starting index.
+   If there is no such group, returns BITMAP_ERROR. */
+size_t
+bitmap_scan_near (const struct bitmap *b, size_t goal, size_t cnt,
+                  bool value)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+
+  if (goal > b->bit_cnt)
+    goal = b->bit_cnt;
+  idx = bitmap_scan (b, goal, cnt, value);
+  if (idx == BITMAP_ERROR && goal > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  return idx;
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
@@ -329,6 +523,17 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
 /* File input and output. */
 
 #ifdef FILESYS
+/* Recomputes all of B's summary. */
+static void
+rebuild_summary (struct bitmap *b)
+{
+  size_t i;
+
+  if (b->summary != NULL)
+    for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+      update_summary (b, i);
+}
+
 /* Returns the number of bytes needed to store B in a file. */
 size_t
 bitmap_file_size (const struct bitmap *b) 
@@ -347,6 +552,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      rebuild_summary (b);
     }
   return success;
 }
@@ -359,6 +565,23 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes of B's file representation that start
+   at byte OFS to the same offset in FILE, leaving the rest of
+   FILE alone.  SIZE is trimmed to the end of B.  Returns true if
+   successful, false otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file,
+                   size_t ofs, size_t size)
+{
+  size_t file_size = byte_cnt (b->bit_cnt);
+
+  ASSERT (ofs <= file_size);
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  return (file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+          == (off_t) size);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
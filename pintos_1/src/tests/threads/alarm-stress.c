@@ -0,0 +1,118 @@
+/* Puts a couple of thousand threads to sleep at once, spread
+   over a range of wake-up ticks and priorities, and checks that
+   no thread wakes up early and that threads sharing a wake-up
+   tick run in order of priority. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 2000         /* Number of sleeping threads. */
+#define TICK_CNT 50             /* Number of distinct wake-up ticks. */
+#define PRI_CNT 16              /* Number of distinct priorities. */
+
+/* Wake-up record for one thread. */
+struct wakeup
+  {
+    int64_t target;             /* Tick the thread was queued to wake at. */
+    int64_t woke;               /* Tick the thread actually ran at. */
+    int priority;               /* Thread's priority. */
+    bool late;                  /* Target had passed, so it never slept. */
+  };
+
+/* Information about the test. */
+struct stress_test
+  {
+    int64_t start;              /* Wake-up ticks are relative to this. */
+    struct wakeup *output;      /* Wake-up records, in wake-up order. */
+    int output_cnt;             /* Number of records so far. */
+    struct semaphore done;      /* Upped by each thread on exit. */
+  };
+
+static thread_func sleeper;
+
+void
+test_alarm_stress (void)
+{
+  struct stress_test test;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Creating %d threads to sleep until one of %d ticks.",
+       THREAD_CNT, TICK_CNT);
+
+  test.output = malloc (sizeof *test.output * THREAD_CNT);
+  if (test.output == NULL)
+    PANIC ("couldn't allocate memory for test");
+  test.output_cnt = 0;
+  sema_init (&test.done, 0);
+
+  /* Leave enough time to create every thread before the first
+     one is due. */
+  test.start = timer_ticks () + THREAD_CNT / 4;
+
+  /* Each sleeper has a higher priority than we do, so it runs
+     and goes to sleep as soon as it is created. */
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT + 1 + i % PRI_CNT,
+                         sleeper, &test) == TID_ERROR)
+        fail ("couldn't create thread %d", i);
+    }
+
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&test.done);
+  msg ("All %d threads woke up.", test.output_cnt);
+
+  /* Verify wake-up order. */
+  for (i = 0; i < test.output_cnt; i++)
+    {
+      struct wakeup *w = &test.output[i];
+      struct wakeup *prev = i > 0 ? &test.output[i - 1] : NULL;
+
+      if (!w->late && w->woke < w->target)
+        fail ("thread woke up %"PRId64" ticks early", w->target - w->woke);
+      if (prev != NULL && !w->late && !prev->late
+          && w->target == prev->target && w->priority > prev->priority)
+        fail ("priority %d thread woke up after priority %d thread "
+              "on the same tick", w->priority, prev->priority);
+    }
+  msg ("Wake-up order is valid.");
+
+  free (test.output);
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *test_)
+{
+  struct stress_test *test = test_;
+  struct thread *t = thread_current ();
+  int64_t delay = test->start + (t->tid * 7) % TICK_CNT - timer_ticks ();
+  enum intr_level old_level;
+  struct wakeup *w;
+
+  timer_sleep (delay);
+
+  /* Use the tick timer_sleep() actually queued us for, since a
+     timer interrupt may have arrived after computing DELAY. */
+  old_level = intr_disable ();
+  w = &test->output[test->output_cnt++];
+  w->target = t->wake_tick;
+  w->woke = timer_ticks ();
+  w->priority = thread_get_priority ();
+  w->late = delay <= 0;
+  intr_set_level (old_level);
+
+  sema_up (&test->done);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-stress) begin
+(alarm-stress) Creating 2000 threads to sleep until one of 50 ticks.
+(alarm-stress) All 2000 threads woke up.
+(alarm-stress) Wake-up order is valid.
+(alarm-stress) end
+EOF
+pass;
@@ -0,0 +1,139 @@
+/* Allocates from a bitmap the way free_map_allocate_near() does,
+   taking the first free group at or after a goal and wrapping
+   around to the start of the map if there is none, and reports
+   where each allocation lands.  Then grows several files at once
+   in a 90%-full map, first fit from bit 0 and with each file's
+   last block as the goal, reporting how fragmented the files end
+   up and how long each method takes. */
+
+#include <bitmap.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "devices/timer.h"
+
+#define SMALL_BITS 2048                 /* Enough elements for a summary. */
+#define BIT_CNT (64 * 1024)             /* One bit per sector of 32 MB. */
+#define FULL_BITS (BIT_CNT / 10 * 9)    /* Leading bits that are set. */
+#define FILE_CNT 8                      /* Files growing at once. */
+#define FILE_BLOCKS 512                 /* Blocks written per file. */
+#define FILE_SPACING ((BIT_CNT - FULL_BITS) / FILE_CNT)
+#define ROUND_CNT 10                    /* Times each method is run. */
+
+static size_t allocate_near (struct bitmap *, size_t goal, size_t cnt);
+static size_t allocate_files (struct bitmap *, bool use_goal,
+                              size_t first[FILE_CNT]);
+
+void
+test_bitmap_near (void)
+{
+  /* Goal and size of each allocation, in order. */
+  static const size_t requests[][2] =
+    {
+      {0, 1}, {11, 2}, {12, 4}, {1505, 5}, {1504, 2}, {2046, 4},
+      {5000, 1}, {0, 43}, {2006, 42}, {0, 1}, {0, 1},
+    };
+  size_t first[FILE_CNT];
+  size_t frags = 0;
+  struct bitmap *b;
+  int64_t start;
+  int i;
+
+  ASSERT (FILE_BLOCKS < FILE_SPACING);
+
+  /* Start with only bits 10...13, 1500...1509, and the last 48
+     bits free. */
+  b = bitmap_create (SMALL_BITS);
+  if (b == NULL)
+    fail ("couldn't allocate bitmap");
+  bitmap_set_all (b, true);
+  bitmap_set_multiple (b, 10, 4, false);
+  bitmap_set_multiple (b, 1500, 10, false);
+  bitmap_set_multiple (b, SMALL_BITS - 48, 48, false);
+  for (i = 0; i < (int) (sizeof requests / sizeof *requests); i++)
+    {
+      size_t idx = allocate_near (b, requests[i][0], requests[i][1]);
+      char result[16];
+
+      if (idx == BITMAP_ERROR)
+        strlcpy (result, "none", sizeof result);
+      else
+        snprintf (result, sizeof result, "%zu", idx);
+      msg ("allocate %zu near %zu: %s", requests[i][1], requests[i][0],
+           result);
+    }
+  bitmap_destroy (b);
+
+  b = bitmap_create (BIT_CNT);
+  if (b == NULL)
+    fail ("couldn't allocate bitmap");
+  msg ("Growing %d files by %d blocks each in a %d-bit map "
+       "that is 90%% full.", FILE_CNT, FILE_BLOCKS, BIT_CNT);
+
+  start = timer_ticks ();
+  for (i = 0; i < ROUND_CNT; i++)
+    frags = allocate_files (b, false, first);
+  msg ("first fit took %"PRId64" ticks for %d rounds.",
+       timer_elapsed (start), ROUND_CNT);
+  msg ("first fit: %zu fragments.", frags);
+
+  start = timer_ticks ();
+  for (i = 0; i < ROUND_CNT; i++)
+    frags = allocate_files (b, true, first);
+  msg ("goal-directed took %"PRId64" ticks for %d rounds.",
+       timer_elapsed (start), ROUND_CNT);
+  msg ("goal-directed: %zu fragments.", frags);
+  for (i = 0; i < FILE_CNT; i++)
+    msg ("goal-directed: file %d starts at %zu.", i, first[i]);
+  bitmap_destroy (b);
+}
+
+/* Allocates CNT consecutive bits of B near GOAL, as
+   free_map_allocate_near() does with the free map, and returns
+   the first one, or BITMAP_ERROR if there is no room. */
+static size_t
+allocate_near (struct bitmap *b, size_t goal, size_t cnt)
+{
+  size_t idx = bitmap_scan_near (b, goal, cnt, false);
+  if (idx != BITMAP_ERROR)
+    bitmap_set_multiple (b, idx, cnt, true);
+  return idx;
+}
+
+/* Fills the first 90% of B, marks an inode for each file spread
+   over the free rest, and then appends blocks to the files in
+   turn, storing each file's first block in FIRST.  Uses the
+   file's last block, or its inode, as the goal if USE_GOAL is
+   true, otherwise scans from bit 0.  Returns the total number of
+   runs of contiguous blocks in the files. */
+static size_t
+allocate_files (struct bitmap *b, bool use_goal, size_t first[FILE_CNT])
+{
+  size_t last[FILE_CNT];
+  size_t frags = 0;
+  int i, j;
+
+  bitmap_set_all (b, false);
+  bitmap_set_multiple (b, 0, FULL_BITS, true);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      last[i] = FULL_BITS + i * FILE_SPACING;
+      bitmap_mark (b, last[i]);
+    }
+
+  for (j = 0; j < FILE_BLOCKS; j++)
+    for (i = 0; i < FILE_CNT; i++)
+      {
+        size_t idx = allocate_near (b, use_goal ? last[i] + 1 : 0, 1);
+        if (idx == BITMAP_ERROR)
+          fail ("bitmap full");
+        if (j == 0)
+          first[i] = idx;
+        if (j == 0 || idx != last[i] + 1)
+          frags++;
+        last[i] = idx;
+      }
+  return frags;
+}
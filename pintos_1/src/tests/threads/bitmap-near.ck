@@ -0,0 +1,41 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Each allocation must land where the goal, the bits already
+# taken, and wrapping around put it.  Interleaved first fit gives
+# every block of every file its own fragment; with goals, each
+# file is one run just past its inode.  Lines that report ticks
+# are informational and not compared.
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = grep (!/ took \d+ ticks for \d+ rounds\.$/, @output);
+compare_output ("run", \@output, [<<'EOF']);
+(bitmap-near) begin
+(bitmap-near) allocate 1 near 0: 10
+(bitmap-near) allocate 2 near 11: 11
+(bitmap-near) allocate 4 near 12: 1500
+(bitmap-near) allocate 5 near 1505: 1505
+(bitmap-near) allocate 2 near 1504: 2000
+(bitmap-near) allocate 4 near 2046: 2002
+(bitmap-near) allocate 1 near 5000: 13
+(bitmap-near) allocate 43 near 0: none
+(bitmap-near) allocate 42 near 2006: 2006
+(bitmap-near) allocate 1 near 0: 1504
+(bitmap-near) allocate 1 near 0: none
+(bitmap-near) Growing 8 files by 512 blocks each in a 65536-bit map that is 90% full.
+(bitmap-near) first fit: 4096 fragments.
+(bitmap-near) goal-directed: 8 fragments.
+(bitmap-near) goal-directed: file 0 starts at 58978.
+(bitmap-near) goal-directed: file 1 starts at 59797.
+(bitmap-near) goal-directed: file 2 starts at 60616.
+(bitmap-near) goal-directed: file 3 starts at 61435.
+(bitmap-near) goal-directed: file 4 starts at 62254.
+(bitmap-near) goal-directed: file 5 starts at 63073.
+(bitmap-near) goal-directed: file 6 starts at 63892.
+(bitmap-near) goal-directed: file 7 starts at 64711.
+(bitmap-near) end
+EOF
+pass;
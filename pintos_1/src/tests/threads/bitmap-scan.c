@@ -0,0 +1,151 @@
+/* Checks bitmap_scan() against known answers on a small bitmap
+   whose free groups straddle element boundaries, and on a large,
+   mostly full one of the kind the page allocator and the free
+   map use, where the summary of non-full elements comes into
+   play.  Then times it against the bit-at-a-time scan that it
+   replaced, which must find the same groups. */
+
+#include <bitmap.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "devices/timer.h"
+
+#define SMALL_BITS 2048                 /* Enough elements for a summary. */
+#define BIT_CNT (1024 * 1024 / 4)       /* One bit per page of 1 GB. */
+#define FULL_BITS (BIT_CNT / 10 * 9)    /* Leading bits that are set. */
+#define SCAN_CNT 20                     /* Scans timed per method. */
+
+/* A scan to run and report. */
+struct scan
+  {
+    size_t start;                       /* First bit to look at. */
+    size_t cnt;                         /* Group size. */
+    bool value;                         /* Value to look for. */
+  };
+
+static void check_scans (const struct bitmap *, const struct scan *,
+                         size_t scan_cnt);
+static size_t bit_scan (const struct bitmap *, size_t start, size_t cnt,
+                        bool value);
+
+void
+test_bitmap_scan (void)
+{
+  static const struct scan small_scans[] =
+    {
+      {0, 1, false}, {0, 4, false}, {0, 5, false}, {31, 2, false},
+      {34, 1, false}, {101, 40, false}, {0, 41, false}, {1001, 8, false},
+      {1033, 8, false}, {2041, 8, false}, {0, 1, true}, {30, 3, true},
+    };
+  static const struct scan large_scans[] =
+    {
+      {0, 1, false}, {0, 4, false}, {0, 16, false}, {0, 64, false},
+      {0, 128, false}, {0, 129, false}, {235950, 1, false},
+    };
+  static const size_t run_lengths[] = {1, 4, 16, 64};
+  enum { RUN_LENGTH_CNT = sizeof run_lengths / sizeof *run_lengths };
+  size_t expected[RUN_LENGTH_CNT];
+  struct bitmap *b;
+  int64_t start;
+  size_t i, j;
+
+  /* Small map: everything is set except bits 30...33, which
+     cross an element boundary, bit 100, bits 1000...1039, and
+     the last 8 bits. */
+  b = bitmap_create (SMALL_BITS);
+  if (b == NULL)
+    fail ("couldn't allocate bitmap");
+  bitmap_set_all (b, true);
+  bitmap_set_multiple (b, 30, 4, false);
+  bitmap_reset (b, 100);
+  bitmap_set_multiple (b, 1000, 40, false);
+  bitmap_set_multiple (b, SMALL_BITS - 8, 8, false);
+  msg ("Small %d-bit map:", SMALL_BITS);
+  check_scans (b, small_scans, sizeof small_scans / sizeof *small_scans);
+  bitmap_destroy (b);
+
+  /* Large map: set the first 90% of the bits.  Past that, set
+     all but one bit in each group of 37, and leave a free run
+     of 128 bits at the end. */
+  b = bitmap_create (BIT_CNT);
+  if (b == NULL)
+    fail ("couldn't allocate bitmap");
+  bitmap_set_multiple (b, 0, FULL_BITS, true);
+  for (i = FULL_BITS; i < BIT_CNT - 128; i++)
+    if (i % 37 != 0)
+      bitmap_mark (b, i);
+  msg ("Large %d-bit map, 90%% full:", BIT_CNT);
+  check_scans (b, large_scans, sizeof large_scans / sizeof *large_scans);
+
+  /* The timings are only for comparison by eye. */
+  start = timer_ticks ();
+  for (i = 0; i < SCAN_CNT; i++)
+    for (j = 0; j < RUN_LENGTH_CNT; j++)
+      expected[j] = bit_scan (b, 0, run_lengths[j], false);
+  msg ("bit-at-a-time: %"PRId64" ticks for %d scans.",
+       timer_elapsed (start), SCAN_CNT * RUN_LENGTH_CNT);
+
+  start = timer_ticks ();
+  for (i = 0; i < SCAN_CNT; i++)
+    for (j = 0; j < RUN_LENGTH_CNT; j++)
+      if (bitmap_scan (b, 0, run_lengths[j], false) != expected[j])
+        fail ("scans for %zu free bits disagree", run_lengths[j]);
+  msg ("word-at-a-time: %"PRId64" ticks for %d scans.",
+       timer_elapsed (start), SCAN_CNT * RUN_LENGTH_CNT);
+
+  bitmap_destroy (b);
+}
+
+/* Runs each of the SCAN_CNT scans in SCANS on B and prints where
+   the group it found starts.  Fails if the bit-at-a-time scan
+   finds a different group. */
+static void
+check_scans (const struct bitmap *b, const struct scan *scans,
+             size_t scan_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < scan_cnt; i++)
+    {
+      const struct scan *s = &scans[i];
+      size_t idx = bitmap_scan (b, s->start, s->cnt, s->value);
+      char result[16];
+
+      if (idx != bit_scan (b, s->start, s->cnt, s->value))
+        fail ("scan from %zu for %zu bits disagrees with bit scan",
+              s->start, s->cnt);
+      if (idx == BITMAP_ERROR)
+        strlcpy (result, "none", sizeof result);
+      else
+        snprintf (result, sizeof result, "%zu", idx);
+      msg ("scan from %zu for %zu %s bits: %s",
+           s->start, s->cnt, s->value ? "set" : "free", result);
+    }
+}
+
+/* The bit-at-a-time scan that bitmap_scan() used to do: tests
+   each possible starting bit in turn, one bit at a time. */
+static size_t
+bit_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t bit_cnt = bitmap_size (b);
+
+  if (cnt <= bit_cnt)
+    {
+      size_t last = bit_cnt - cnt;
+      size_t i, j;
+
+      for (i = start; i <= last; i++)
+        {
+          for (j = 0; j < cnt; j++)
+            if (bitmap_test (b, i + j) != value)
+              break;
+          if (j == cnt)
+            return i;
+        }
+    }
+  return BITMAP_ERROR;
+}
@@ -0,0 +1,39 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# The scan results below were worked out by hand from the bit
+# patterns that the test sets up.  The two timing lines depend on
+# the machine, so they are dropped before comparing.
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = grep (!/^\(bitmap-scan\) \S+-at-a-time: \d+ ticks for \d+ scans\.$/,
+		@output);
+compare_output ("run", \@output, [<<'EOF']);
+(bitmap-scan) begin
+(bitmap-scan) Small 2048-bit map:
+(bitmap-scan) scan from 0 for 1 free bits: 30
+(bitmap-scan) scan from 0 for 4 free bits: 30
+(bitmap-scan) scan from 0 for 5 free bits: 1000
+(bitmap-scan) scan from 31 for 2 free bits: 31
+(bitmap-scan) scan from 34 for 1 free bits: 100
+(bitmap-scan) scan from 101 for 40 free bits: 1000
+(bitmap-scan) scan from 0 for 41 free bits: none
+(bitmap-scan) scan from 1001 for 8 free bits: 1001
+(bitmap-scan) scan from 1033 for 8 free bits: 2040
+(bitmap-scan) scan from 2041 for 8 free bits: none
+(bitmap-scan) scan from 0 for 1 set bits: 0
+(bitmap-scan) scan from 30 for 3 set bits: 34
+(bitmap-scan) Large 262144-bit map, 90% full:
+(bitmap-scan) scan from 0 for 1 free bits: 235949
+(bitmap-scan) scan from 0 for 4 free bits: 262016
+(bitmap-scan) scan from 0 for 16 free bits: 262016
+(bitmap-scan) scan from 0 for 64 free bits: 262016
+(bitmap-scan) scan from 0 for 128 free bits: 262016
+(bitmap-scan) scan from 0 for 129 free bits: none
+(bitmap-scan) scan from 235950 for 1 free bits: 235986
+(bitmap-scan) end
+EOF
+pass;
@@ -0,0 +1,206 @@
+/* Fills the user pool with blocks of pages at 10%, 50% and 90%
+   occupancy and reports how many blocks the buddy allocator hands
+   out.  Single pages must account for every free page, and 4-page
+   blocks for every free group of 4 pages that is aligned to 4
+   pages.  Then frees the whole pool and takes it back in the
+   largest blocks available, which shows whether freed buddies
+   merged back into the fewest blocks.
+
+   For comparison, also times the same fills against a bitmap
+   scanned first fit, the way the page pools used to work, with
+   the same pages in use. */
+
+#include <bitmap.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define MAX_PAGES 4096                  /* Most user pages we track. */
+#define ROUND_CNT 200                   /* Fills timed per method. */
+
+static void **pages;                    /* Pages we hold, by index. */
+static void **blocks;                   /* Blocks handed out by a fill. */
+static size_t page_cnt;                 /* Number of user pages. */
+
+static size_t buddy_fill (size_t block_pages);
+static size_t bitmap_fill (struct bitmap *, size_t block_pages);
+static size_t take_largest (void);
+
+void
+test_palloc_buddy (void)
+{
+  static const int percents[] = {10, 50, 90};
+  static const size_t block_sizes[] = {1, 4};
+  uint8_t *low = NULL;
+  struct bitmap *b;
+  size_t i, j, k;
+
+  pages = malloc (MAX_PAGES * sizeof *pages);
+  blocks = malloc (MAX_PAGES * sizeof *blocks);
+  if (pages == NULL || blocks == NULL)
+    fail ("out of memory");
+
+  /* Take every user page, and index them by address.  Nothing
+     else uses the user pool, so the lowest page is the pool's
+     base, and buddies are aligned relative to it. */
+  for (i = 0; i < MAX_PAGES; i++)
+    {
+      blocks[i] = palloc_get_page (PAL_USER);
+      if (blocks[i] == NULL)
+        break;
+      if (low == NULL || (uint8_t *) blocks[i] < low)
+        low = blocks[i];
+    }
+  page_cnt = i;
+  if (page_cnt == 0 || page_cnt == MAX_PAGES)
+    fail ("can't take all %zu user pages", page_cnt);
+  for (i = 0; i < page_cnt; i++)
+    pages[i] = NULL;
+  for (i = 0; i < page_cnt; i++)
+    {
+      size_t idx = ((uint8_t *) blocks[i] - low) / PGSIZE;
+      if (idx >= page_cnt)
+        fail ("user pool is not contiguous");
+      pages[idx] = blocks[i];
+    }
+  msg ("User pool has %zu pages.", page_cnt);
+
+  b = bitmap_create (page_cnt);
+  if (b == NULL)
+    fail ("couldn't allocate bitmap");
+
+  for (i = 0; i < sizeof percents / sizeof *percents; i++)
+    {
+      /* Keep a scattered PERCENT% of the pages, in runs of 3 so
+         that free runs straddle 4-page boundaries, and free the
+         rest, marking the same ones in use in the bitmap. */
+      bitmap_set_all (b, true);
+      for (j = 0; j < page_cnt; j++)
+        if (j / 3 * 7 % 10 >= (size_t) percents[i] / 10)
+          {
+            palloc_free_page (pages[j]);
+            pages[j] = NULL;
+            bitmap_reset (b, j);
+          }
+
+      for (k = 0; k < sizeof block_sizes / sizeof *block_sizes; k++)
+        {
+          size_t bitmap_blocks = 0, buddy_blocks = 0;
+          int64_t bitmap_ticks, buddy_ticks;
+          int round;
+
+          bitmap_ticks = timer_ticks ();
+          for (round = 0; round < ROUND_CNT; round++)
+            bitmap_blocks = bitmap_fill (b, block_sizes[k]);
+          bitmap_ticks = timer_elapsed (bitmap_ticks);
+
+          buddy_ticks = timer_ticks ();
+          for (round = 0; round < ROUND_CNT; round++)
+            buddy_blocks = buddy_fill (block_sizes[k]);
+          buddy_ticks = timer_elapsed (buddy_ticks);
+
+          msg ("%d%% full: buddy hands out %zu %zu-page blocks.",
+               percents[i], buddy_blocks, block_sizes[k]);
+          msg ("%d%% full, %zu-page blocks: bitmap %"PRId64" ticks, "
+               "%zu blocks; buddy %"PRId64" ticks.",
+               percents[i], block_sizes[k], bitmap_ticks, bitmap_blocks,
+               buddy_ticks);
+        }
+
+      /* Take the freed pages back for the next occupancy. */
+      for (;;)
+        {
+          uint8_t *page = palloc_get_page (PAL_USER);
+          if (page == NULL)
+            break;
+          pages[(page - low) / PGSIZE] = page;
+        }
+      for (j = 0; j < page_cnt; j++)
+        if (pages[j] == NULL)
+          fail ("couldn't take back freed pages");
+    }
+
+  for (j = 0; j < page_cnt; j++)
+    palloc_free_page (pages[j]);
+  msg ("Freed pool comes back as %zu blocks.", take_largest ());
+
+  bitmap_destroy (b);
+  free (blocks);
+  free (pages);
+}
+
+/* Allocates BLOCK_PAGES-page blocks from the user pool until it
+   runs out, then frees them all again.  Returns the number of
+   blocks allocated. */
+static size_t
+buddy_fill (size_t block_pages)
+{
+  size_t cnt, i;
+
+  for (cnt = 0; cnt < MAX_PAGES; cnt++)
+    {
+      blocks[cnt] = palloc_get_multiple (PAL_USER, block_pages);
+      if (blocks[cnt] == NULL)
+        break;
+    }
+  for (i = 0; i < cnt; i++)
+    palloc_free_multiple (blocks[i], block_pages);
+  return cnt;
+}
+
+/* Does the same as buddy_fill() with B standing in for the user
+   pool, scanning it from the start for each block. */
+static size_t
+bitmap_fill (struct bitmap *b, size_t block_pages)
+{
+  size_t cnt, i;
+
+  for (cnt = 0; cnt < MAX_PAGES; cnt++)
+    {
+      size_t idx = bitmap_scan_and_flip (b, 0, block_pages, false);
+      if (idx == BITMAP_ERROR)
+        break;
+      blocks[cnt] = (void *) idx;
+    }
+  for (i = 0; i < cnt; i++)
+    bitmap_set_multiple (b, (size_t) blocks[i], block_pages, false);
+  return cnt;
+}
+
+/* Takes all of the free user pool, allocating blocks of the
+   largest power-of-2 size first and working down to single
+   pages, then frees them again.  Returns the number of blocks
+   taken.  If every freed block has merged with its buddy, that
+   is one block per 1 bit in the pool size. */
+static size_t
+take_largest (void)
+{
+  size_t got[sizeof (size_t) * 8];      /* Blocks taken, by log2 size. */
+  size_t cnt = 0, i;
+  int order, top = 0;
+
+  while (((size_t) 2 << top) <= page_cnt)
+    top++;
+  for (order = top; order >= 0; order--)
+    {
+      got[order] = 0;
+      while (cnt < MAX_PAGES)
+        {
+          blocks[cnt] = palloc_get_multiple (PAL_USER, (size_t) 1 << order);
+          if (blocks[cnt] == NULL)
+            break;
+          got[order]++;
+          cnt++;
+        }
+    }
+
+  i = 0;
+  for (order = top; order >= 0; order--)
+    for (; got[order] > 0; got[order]--)
+      palloc_free_multiple (blocks[i++], (size_t) 1 << order);
+  return cnt;
+}
@@ -0,0 +1,41 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The pool size depends on the amount of RAM, so rebuild the
+# test's occupancy pattern for the size it reports and work out
+# what a correct buddy allocator hands out from that: every free
+# page, every free 4-page group aligned to 4 pages, and, once the
+# pool is freed, one block per 1 bit of its size.  Bitmap counts
+# and ticks are for comparison only.
+my ($page_cnt);
+foreach (@output) {
+    $page_cnt = $1, last if /^\(palloc-buddy\) User pool has (\d+) pages\.$/;
+}
+fail "missing user pool size\n" if !defined $page_cnt;
+
+my (@expected) = ("(palloc-buddy) begin",
+		  "(palloc-buddy) User pool has $page_cnt pages.");
+foreach my $percent (10, 50, 90) {
+    my (@free) = map (int ($_ / 3) * 7 % 10 >= $percent / 10, 0...$page_cnt - 1);
+    my ($pages) = scalar (grep ($_, @free));
+    my ($groups) = 0;
+    for (my ($i) = 0; $i + 4 <= $page_cnt; $i += 4) {
+	$groups++ if $free[$i] && $free[$i + 1] && $free[$i + 2] && $free[$i + 3];
+    }
+    push (@expected,
+	  "(palloc-buddy) $percent% full: buddy hands out $pages 1-page blocks.",
+	  "(palloc-buddy) $percent% full: buddy hands out $groups 4-page blocks.");
+}
+my ($blocks) = unpack ("%32b*", pack ("N", $page_cnt));
+push (@expected, "(palloc-buddy) Freed pool comes back as $blocks blocks.",
+      "(palloc-buddy) end");
+
+@output = grep (!/ ticks, /, @output);
+compare_output ("run", \@output, [join ("\n", @expected)]);
+pass;
@@ -0,0 +1,229 @@
+/* Checks slab caches for a few sizes of kernel objects: a batch
+   of live objects must not overlap and must pack into the fewest
+   pages, every object handed out must have been through the
+   cache's constructor, and an object given back with plain free()
+   must return to its cache.  Then compares the caches against
+   malloc() on the number of pages a batch of live objects takes
+   and on the time taken by bursts of allocations and frees. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define OBJ_CNT 256                     /* Live objects for counting pages. */
+#define BURST 64                        /* Objects per timed burst. */
+#define ROUND_CNT 2000                  /* Timed bursts per allocator. */
+#define CTOR_BYTE 0xa5                  /* Constructor's fill pattern. */
+
+static void *objs[OBJ_CNT];
+static size_t ctor_size;                /* Bytes for construct() to fill. */
+static int ctor_cnt;                    /* Calls to construct(). */
+
+static void check_cache (size_t size);
+static void construct (void *);
+static void check_constructed (const void *, size_t size);
+static size_t count_pages (void);
+static void *cache_alloc (void *cache, size_t size);
+static void cache_free (void *cache, void *p);
+static void *malloc_alloc (void *cache, size_t size);
+static void malloc_free (void *cache, void *p);
+static void measure (void *(*alloc) (void *, size_t),
+                     void (*free_) (void *, void *),
+                     void *cache, size_t size,
+                     size_t *pages, int64_t *ticks);
+
+void
+test_slab_alloc (void)
+{
+  /* Sizes of a struct file, a 300-byte object, and a struct
+     inode with its copy of the on-disk inode. */
+  static const size_t sizes[] = {12, 300, 580};
+  size_t i;
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      struct kmem_cache *cache = kmem_cache_create (sizes[i], NULL);
+      size_t malloc_pages, cache_pages;
+      int64_t malloc_ticks, cache_ticks;
+
+      if (cache == NULL)
+        fail ("couldn't create cache");
+      check_cache (sizes[i]);
+      measure (malloc_alloc, malloc_free, NULL, sizes[i],
+               &malloc_pages, &malloc_ticks);
+      measure (cache_alloc, cache_free, cache, sizes[i],
+               &cache_pages, &cache_ticks);
+
+      msg ("%zu-byte objects, for comparison: malloc %zu pages, "
+           "%"PRId64" ticks; kmem_cache %zu pages, %"PRId64" ticks.",
+           sizes[i], malloc_pages, malloc_ticks, cache_pages, cache_ticks);
+      if (cache_pages > malloc_pages)
+        fail ("kmem_cache used more pages than malloc");
+    }
+}
+
+/* Fills a new cache of SIZE-byte objects, with construct() as its
+   constructor, with OBJ_CNT live objects and checks them, then
+   frees them, half with free() and half with kmem_cache_free().
+   Prints how many pages the objects took and how many times the
+   constructor ran. */
+static void
+check_cache (size_t size)
+{
+  struct kmem_cache *cache = kmem_cache_create (size, construct);
+  uint8_t *p, *q;
+  size_t pages;
+  size_t i, j;
+
+  if (cache == NULL)
+    fail ("couldn't create cache");
+  ctor_size = size;
+  ctor_cnt = 0;
+
+  for (i = 0; i < OBJ_CNT; i++)
+    {
+      objs[i] = kmem_cache_alloc (cache);
+      if (objs[i] == NULL)
+        fail ("out of memory");
+      check_constructed (objs[i], size);
+    }
+  for (i = 0; i < OBJ_CNT; i++)
+    for (j = 0; j < i; j++)
+      {
+        uint8_t *a = objs[i], *b = objs[j];
+        if (a < b + size && b < a + size)
+          fail ("%zu-byte objects %p and %p overlap", size, a, b);
+      }
+  pages = count_pages ();
+
+  /* Scribble on the objects so that reuse without construction
+     shows up. */
+  for (i = 0; i < OBJ_CNT; i++)
+    memset (objs[i], 0, size);
+  for (i = 0; i < OBJ_CNT; i++)
+    if (i % 2 == 0)
+      free (objs[i]);
+    else
+      kmem_cache_free (cache, objs[i]);
+
+  /* free() must hand an object back to its own cache, which gives
+     it out again next, constructed afresh. */
+  p = kmem_cache_alloc (cache);
+  if (p == NULL)
+    fail ("out of memory");
+  memset (p, 0, size);
+  free (p);
+  q = kmem_cache_alloc (cache);
+  if (q != p)
+    fail ("object freed with free() did not go back to its cache");
+  check_constructed (q, size);
+  kmem_cache_free (cache, q);
+
+  msg ("%zu-byte cache: %d objects on %zu pages, constructor ran %d times.",
+       size, OBJ_CNT, pages, ctor_cnt);
+}
+
+/* Constructor for check_cache()'s caches. */
+static void
+construct (void *p)
+{
+  memset (p, CTOR_BYTE, ctor_size);
+  ctor_cnt++;
+}
+
+/* Fails unless the SIZE bytes at P are as construct() left
+   them. */
+static void
+check_constructed (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (p[i] != CTOR_BYTE)
+      fail ("object %p was not constructed", p);
+}
+
+/* Allocates OBJ_CNT objects of SIZE bytes with ALLOC and stores
+   the number of pages they occupy in *PAGES, then frees them with
+   FREE_.  Then times ROUND_CNT bursts of BURST allocations
+   followed by BURST frees and stores the time in *TICKS. */
+static void
+measure (void *(*alloc) (void *, size_t), void (*free_) (void *, void *),
+         void *cache, size_t size, size_t *pages, int64_t *ticks)
+{
+  int64_t start;
+  size_t i;
+  int round;
+
+  for (i = 0; i < OBJ_CNT; i++)
+    {
+      objs[i] = alloc (cache, size);
+      if (objs[i] == NULL)
+        fail ("out of memory");
+    }
+  *pages = count_pages ();
+  for (i = 0; i < OBJ_CNT; i++)
+    free_ (cache, objs[i]);
+
+  start = timer_ticks ();
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      for (i = 0; i < BURST; i++)
+        {
+          objs[i] = alloc (cache, size);
+          if (objs[i] == NULL)
+            fail ("out of memory");
+        }
+      for (i = 0; i < BURST; i++)
+        free_ (cache, objs[i]);
+    }
+  *ticks = timer_elapsed (start);
+}
+
+/* Returns the number of distinct pages that hold the objects in
+   OBJS. */
+static size_t
+count_pages (void)
+{
+  size_t cnt = 0;
+  size_t i, j;
+
+  for (i = 0; i < OBJ_CNT; i++)
+    {
+      for (j = 0; j < i; j++)
+        if (pg_round_down (objs[j]) == pg_round_down (objs[i]))
+          break;
+      if (j == i)
+        cnt++;
+    }
+  return cnt;
+}
+
+static void *
+cache_alloc (void *cache, size_t size UNUSED)
+{
+  return kmem_cache_alloc (cache);
+}
+
+static void
+cache_free (void *cache, void *p)
+{
+  kmem_cache_free (cache, p);
+}
+
+static void *
+malloc_alloc (void *cache UNUSED, size_t size)
+{
+  return malloc (size);
+}
+
+static void
+malloc_free (void *cache UNUSED, void *p)
+{
+  free (p);
+}
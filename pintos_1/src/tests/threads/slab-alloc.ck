@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# An arena is one page with a 12-byte header, which leaves room
+# for 340 12-byte, 13 300-byte, or 7 580-byte objects, so 256 live
+# objects fill 1, 20, and 37 pages.  The constructor runs for each
+# of those objects and for the two allocations of the free()
+# round trip.  How malloc() compares depends on what else the
+# kernel has allocated, so those lines are not checked here.
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = grep (!/, for comparison: /, @output);
+compare_output ("run", \@output, [<<'EOF']);
+(slab-alloc) begin
+(slab-alloc) 12-byte cache: 256 objects on 1 pages, constructor ran 258 times.
+(slab-alloc) 300-byte cache: 256 objects on 20 pages, constructor ran 258 times.
+(slab-alloc) 580-byte cache: 256 objects on 37 pages, constructor ran 258 times.
+(slab-alloc) end
+EOF
+pass;
@@ -0,0 +1,79 @@
+/* Reads a file into pages that have only been read from, so that
+   the kernel reads straight into clean frames, then touches enough
+   other memory to evict them.  The file's data must come back
+   intact.  Then reads the file again into pages that are out on
+   swap and checks it once more. */
+
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/arc4.h"
+#include "tests/cksum.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define DATA_SIZE (64 * 1024)
+#define PAGE_SIZE 4096
+
+static char buf[SIZE];
+
+/* Page-aligned parts of BUF. */
+static char *data;              /* Contents written to the file. */
+static char *target;            /* Where the file is read back. */
+static char *pressure;          /* The rest, written to evict pages. */
+
+static void read_and_check (int handle, unsigned long expected);
+
+void
+test_main (void)
+{
+  struct arc4 arc4;
+  unsigned long expected;
+  int handle;
+  size_t i;
+  char sum = 0;
+
+  data = (char *) ROUND_UP ((uintptr_t) buf, PAGE_SIZE);
+  target = data + DATA_SIZE;
+  pressure = target + DATA_SIZE;
+
+  memset (data, 0, DATA_SIZE);
+  arc4_init (&arc4, "foobar", 6);
+  arc4_crypt (&arc4, data, DATA_SIZE);
+  expected = cksum (data, DATA_SIZE);
+  CHECK (create ("data", DATA_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (write (handle, data, DATA_SIZE) == DATA_SIZE, "write \"data\"");
+
+  /* Fault the target pages in by reading them only, so that they
+     are zero pages in clean frames. */
+  for (i = 0; i < DATA_SIZE; i += PAGE_SIZE)
+    sum |= target[i];
+  if (sum != 0)
+    fail ("fresh page is not zeroed");
+
+  msg ("read \"data\" into clean pages");
+  read_and_check (handle, expected);
+
+  /* read_and_check() left the target pages out on swap. */
+  msg ("read \"data\" into evicted pages");
+  read_and_check (handle, expected);
+
+  close (handle);
+}
+
+/* Reads the file open as HANDLE into TARGET, writes all of
+   PRESSURE to evict TARGET's pages, and checks that TARGET's
+   checksum is still EXPECTED. */
+static void
+read_and_check (int handle, unsigned long expected)
+{
+  seek (handle, 0);
+  if (read (handle, target, DATA_SIZE) != DATA_SIZE)
+    fail ("read \"data\" failed");
+  memset (pressure, 0x5a, buf + SIZE - pressure);
+  if (cksum (target, DATA_SIZE) != expected)
+    fail ("data read into memory was lost after eviction");
+}
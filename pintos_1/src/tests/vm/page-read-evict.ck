@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-read-evict) begin
+(page-read-evict) create "data"
+(page-read-evict) open "data"
+(page-read-evict) write "data"
+(page-read-evict) read "data" into clean pages
+(page-read-evict) read "data" into evicted pages
+(page-read-evict) end
+EOF
+pass;
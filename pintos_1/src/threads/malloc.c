@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +33,29 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   A slab cache, created with kmem_cache_create(), is a
+   descriptor of its own for objects of one exact size, so that
+   frequently allocated kernel structures don't waste the rest
+   of a power-of-2 block.  Objects from a cache may be freed
+   with either kmem_cache_free() or free().
+
+   Each descriptor also keeps a small magazine of free blocks.
+   Allocating and freeing pop and push blocks there with
+   interrupts off and only take the descriptor's lock, and touch
+   its free list, when the magazine is empty or full.  Blocks in
+   a magazine still count as in use in their arena. */
+
+/* Number of free blocks in a magazine. */
+#define MAGAZINE_SIZE 16
+
+/* A descriptor's stack of recently freed blocks. */
+struct magazine
+  {
+    void *blocks[MAGAZINE_SIZE];
+    size_t cnt;
+  };
 
 /* Descriptor. */
 struct desc
@@ -41,6 +64,14 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    kmem_ctor_func *ctor;       /* Called on each allocated block. */
+    struct magazine magazine;   /* Recently freed blocks. */
+  };
+
+/* Slab cache. */
+struct kmem_cache
+  {
+    struct desc desc;           /* Descriptor for the cache's objects. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -66,6 +97,9 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void desc_init (struct desc *, size_t block_size, kmem_ctor_func *);
+static void *desc_alloc (struct desc *);
+static void desc_free (struct desc *, struct block *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -77,10 +111,48 @@ malloc_init (void)
     {
       struct desc *d = &descs[desc_cnt++];
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      desc_init (d, block_size, NULL);
+    }
+}
+
+/* Creates and returns a cache of objects of SIZE bytes each,
+   which must fit at least once in a page along with an arena
+   header.  If CTOR is non-null, it is called on every object
+   that kmem_cache_alloc() returns.  Returns a null pointer if
+   memory is not available. */
+struct kmem_cache *
+kmem_cache_create (size_t size, kmem_ctor_func *ctor) 
+{
+  struct kmem_cache *c;
+  size_t block_size = ROUND_UP (size, sizeof (void *));
+
+  if (block_size < sizeof (struct block))
+    block_size = sizeof (struct block);
+  ASSERT (block_size <= PGSIZE - sizeof (struct arena));
+
+  c = malloc (sizeof *c);
+  if (c != NULL)
+    desc_init (&c->desc, block_size, ctor);
+  return c;
+}
+
+/* Obtains and returns an object from cache C.
+   Returns a null pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) 
+{
+  return desc_alloc (&c->desc);
+}
+
+/* Frees object P, which must have been allocated from cache C
+   with kmem_cache_alloc().  Equivalent to free(P). */
+void
+kmem_cache_free (struct kmem_cache *c, void *p) 
+{
+  if (p != NULL)
+    {
+      ASSERT (block_to_arena (p)->desc == &c->desc);
+      free (p);
     }
 }
 
@@ -90,7 +162,6 @@ void *
 malloc (size_t size) 
 {
   struct desc *d;
-  struct block *b;
   struct arena *a;
 
   /* A null pointer satisfies a request for 0 bytes. */
@@ -119,6 +190,40 @@ malloc (size_t size)
       return a + 1;
     }
 
+  return desc_alloc (d);
+}
+
+/* Initializes descriptor D for blocks of BLOCK_SIZE bytes, with
+   constructor CTOR. */
+static void
+desc_init (struct desc *d, size_t block_size, kmem_ctor_func *ctor) 
+{
+  d->block_size = block_size;
+  d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+  list_init (&d->free_list);
+  lock_init (&d->lock);
+  d->ctor = ctor;
+  memset (&d->magazine, 0, sizeof d->magazine);
+}
+
+/* Obtains and returns a block from descriptor D, from its
+   magazine if it has one and otherwise from D's free list.
+   Returns a null pointer if memory is not available. */
+static void *
+desc_alloc (struct desc *d) 
+{
+  struct magazine *m = &d->magazine;
+  enum intr_level old_level;
+  struct block *b = NULL;
+  struct arena *a;
+
+  old_level = intr_disable ();
+  if (m->cnt > 0)
+    b = m->blocks[--m->cnt];
+  intr_set_level (old_level);
+  if (b != NULL)
+    goto done;
+
   lock_acquire (&d->lock);
 
   /* If the free list is empty, create a new arena. */
@@ -150,6 +255,10 @@ malloc (size_t size)
   a = block_to_arena (b);
   a->free_cnt--;
   lock_release (&d->lock);
+
+ done:
+  if (d->ctor != NULL)
+    d->ctor (b);
   return b;
 }
 
@@ -185,6 +294,38 @@ block_size (void *block)
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Tries to resize OLD_BLOCK to NEW_SIZE bytes without moving
+   it.  A block from a descriptor stays put if it is already big
+   enough.  A big block gives back the pages it no longer needs,
+   or takes the pages right after it if they are free.  Returns
+   true if successful. */
+static bool
+resize_in_place (void *old_block, size_t new_size) 
+{
+  struct arena *a = block_to_arena (old_block);
+  size_t page_cnt;
+
+  if (new_size <= block_size (old_block))
+    {
+      if (a->desc == NULL)
+        {
+          page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+          palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                                a->free_cnt - page_cnt);
+          a->free_cnt = page_cnt;
+        }
+      return true;
+    }
+  if (a->desc != NULL)
+    return false;
+
+  page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+  if (!palloc_extend (a, a->free_cnt, page_cnt))
+    return false;
+  a->free_cnt = page_cnt;
+  return true;
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
@@ -199,6 +340,8 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && resize_in_place (old_block, new_size))
+    return old_block;
   else 
     {
       void *new_block = malloc (new_size);
@@ -232,27 +375,8 @@ free (void *p)
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
-            {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
-            }
 
-          lock_release (&d->lock);
+          desc_free (d, b);
         }
       else
         {
@@ -263,6 +387,48 @@ free (void *p)
     }
 }
 
+/* Gives block B back to descriptor D: to its magazine if it
+   has room, otherwise to D's free list. */
+static void
+desc_free (struct desc *d, struct block *b) 
+{
+  struct magazine *m = &d->magazine;
+  enum intr_level old_level;
+  struct arena *a = block_to_arena (b);
+  bool cached = false;
+
+  old_level = intr_disable ();
+  if (m->cnt < MAGAZINE_SIZE)
+    {
+      m->blocks[m->cnt++] = b;
+      cached = true;
+    }
+  intr_set_level (old_level);
+  if (cached)
+    return;
+
+  lock_acquire (&d->lock);
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      palloc_free_page (a);
+    }
+
+  lock_release (&d->lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -10,4 +10,11 @@ void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
 
+/* Slab caches of objects of one size. */
+struct kmem_cache;
+typedef void kmem_ctor_func (void *);
+struct kmem_cache *kmem_cache_create (size_t size, kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+
 #endif /* threads/malloc.h */
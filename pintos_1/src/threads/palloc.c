@@ -2,13 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,14 +24,60 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Its free pages are
+   kept as blocks of 2**ORDER pages, aligned to their size
+   relative to the pool base, on one free list per order.  An
+   allocation takes a block from the smallest order that is big
+   enough, splitting larger blocks in half as needed, and gives
+   back the pages it doesn't need.  Freeing a block merges it
+   with its buddy, the other half of the next larger block,
+   whenever the buddy is free too.  Both take O(log n) time.
+
+   The free lists are protected by disabling interrupts rather
+   than by a lock, because thread_schedule_tail() frees the
+   pages of a dying thread with interrupts already off.
+
+   Most allocations are of single pages: thread stacks, page
+   tables, user pages.  Each pool keeps a small cache of free
+   pages in front of the buddy allocator, so that the common
+   palloc_get_page() and palloc_free_page() just pop and push a
+   page there.  An empty cache is refilled, and a full one
+   drained, CACHE_BATCH pages at a time.  Pages in a cache are
+   still marked used in the pool's used_map, so freeing a single
+   page also searches the cache for it to catch double frees. */
+
+/* Number of block orders.  The largest block is
+   2**(ORDER_CNT - 1) pages. */
+#define ORDER_CNT 20
+
+/* Page cache size, and how many pages to move between
+   it and the buddy allocator at once. */
+#define CACHE_PAGES 32
+#define CACHE_BATCH (CACHE_PAGES / 2)
+
+/* A pool's cache of free single pages. */
+struct page_cache
+  {
+    void *pages[CACHE_PAGES];           /* Free pages, used as a stack. */
+    size_t page_cnt;                    /* Number of pages in PAGES. */
+
+    /* Statistics. */
+    long long hits;                     /* Allocations served from PAGES. */
+    long long misses;                   /* Allocations that refilled it. */
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct bitmap *used_map;            /* Bitmap of used pages. */
+    uint8_t *free_order;                /* Per page: 1 + order if the
+                                           page starts a free block,
+                                           otherwise 0. */
+    struct list free_lists[ORDER_CNT];  /* Free blocks of each order. */
     uint8_t *base;                      /* Base of pool. */
+    struct page_cache cache;            /* Free single pages. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +86,15 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t allocate_block (struct pool *, size_t page_cnt);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void take_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void *cache_get_page (struct pool *);
+static void cache_free_page (struct pool *, void *page);
+static void cache_drain (struct pool *, size_t cnt);
+#ifndef NDEBUG
+static bool page_cached (const struct pool *, void *page);
+#endif
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -71,20 +127,34 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+  old_level = intr_disable ();
+  if (page_cnt == 1)
+    pages = cache_get_page (pool);
   else
-    pages = NULL;
+    {
+      page_idx = allocate_block (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR)
+        {
+          /* The pages we need may be sitting in the cache. */
+          cache_drain (pool, pool->cache.page_cnt);
+          page_idx = allocate_block (pool, page_cnt);
+        }
+      if (page_idx != BITMAP_ERROR)
+        {
+          bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+          pages = pool->base + PGSIZE * page_idx;
+        }
+      else
+        pages = NULL;
+    }
+  intr_set_level (old_level);
 
   if (pages != NULL) 
     {
@@ -118,6 +188,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -137,8 +208,72 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  ASSERT (page_cnt > 1 || !page_cached (pool, pages));
+  if (page_cnt == 1)
+    cache_free_page (pool, pages);
+  else
+    {
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+      free_range (pool, page_idx, page_cnt);
+    }
+  intr_set_level (old_level);
+}
+
+/* Tries to grow the PAGE_CNT pages starting at PAGES, which
+   must have been obtained with palloc_get_multiple(), to
+   NEW_PAGE_CNT pages by taking the pages that follow them.
+   Returns true if successful, false if any of those pages is in
+   use or outside the pool, in which case nothing changes. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_page_cnt) 
+{
+  struct pool *pool;
+  enum intr_level old_level;
+  size_t page_idx, extra;
+  bool success;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (new_page_cnt >= page_cnt);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base) + page_cnt;
+  extra = new_page_cnt - page_cnt;
+  if (page_idx + extra > bitmap_size (pool->used_map))
+    return false;
+
+  old_level = intr_disable ();
+  success = bitmap_none (pool->used_map, page_idx, extra);
+  if (!success)
+    {
+      /* The pages we need may be sitting in the cache. */
+      cache_drain (pool, pool->cache.page_cnt);
+      success = bitmap_none (pool->used_map, page_idx, extra);
+    }
+  if (success)
+    {
+      take_range (pool, page_idx, extra);
+      bitmap_set_multiple (pool->used_map, page_idx, extra, true);
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Prints statistics about the page caches. */
+void
+palloc_print_stats (void) 
+{
+  printf ("Palloc: page cache %lld hits, %lld misses in kernel pool, "
+          "%lld hits, %lld misses in user pool\n",
+          kernel_pool.cache.hits, kernel_pool.cache.misses,
+          user_pool.cache.hits, user_pool.cache.misses);
 }
 
 /* Frees the page at PAGE. */
@@ -153,10 +288,12 @@ palloc_free_page (void *page)
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and free_order at its base.
+     Calculate the space needed for them and subtract it from the
+     pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -164,9 +301,16 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->free_order = (uint8_t *) base + bm_size;
+  memset (p->free_order, 0, page_cnt);
+  for (order = 0; order < ORDER_CNT; order++)
+    list_init (&p->free_lists[order]);
   p->base = base + bm_pages * PGSIZE;
+  memset (&p->cache, 0, sizeof p->cache);
+
+  /* Every page starts out free. */
+  free_range (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -180,3 +324,224 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free list element stored at the start of page
+   PAGE_IDX in POOL. */
+static struct list_elem *
+page_elem (const struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + page_idx * PGSIZE);
+}
+
+/* Returns the index of the page in POOL that holds free list
+   element E. */
+static size_t
+elem_page (const struct pool *pool, struct list_elem *e)
+{
+  return ((uint8_t *) e - pool->base) / PGSIZE;
+}
+
+/* Puts the free block of 2**ORDER pages at PAGE_IDX onto POOL's
+   free list for ORDER, without trying to merge it. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order)
+{
+  pool->free_order[page_idx] = order + 1;
+  list_push_front (&pool->free_lists[order], page_elem (pool, page_idx));
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, first
+   merging it with its buddy for as long as the buddy is a free
+   block of the same order. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  size_t page_cnt = bitmap_size (pool->used_map);
+
+  while (order + 1 < ORDER_CNT)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+      if (buddy + ((size_t) 1 << order) > page_cnt
+          || pool->free_order[buddy] != order + 1)
+        break;
+
+      list_remove (page_elem (pool, buddy));
+      pool->free_order[buddy] = 0;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, as the
+   fewest aligned blocks that cover them. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order + 1 < ORDER_CNT
+             && page_idx % ((size_t) 1 << (order + 1)) == 0
+             && ((size_t) 1 << (order + 1)) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Takes the PAGE_CNT pages starting at PAGE_IDX, which must all
+   be free, off POOL's free lists.  Each free block that holds
+   some of them is removed, and its pages before and after the
+   range go back on the free lists. */
+static void
+take_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t end = page_idx + page_cnt;
+
+  while (page_idx < end)
+    {
+      size_t head = page_idx, block_end, take_end;
+      int order;
+
+      /* Find the free block that holds PAGE_IDX. */
+      for (order = 0; order < ORDER_CNT; order++)
+        {
+          head = page_idx & ~(((size_t) 1 << order) - 1);
+          if (pool->free_order[head] == order + 1)
+            break;
+        }
+      ASSERT (order < ORDER_CNT);
+
+      list_remove (page_elem (pool, head));
+      pool->free_order[head] = 0;
+      block_end = head + ((size_t) 1 << order);
+      take_end = block_end < end ? block_end : end;
+
+      free_range (pool, head, page_idx - head);
+      free_range (pool, take_end, block_end - take_end);
+      page_idx = take_end;
+    }
+}
+
+/* Takes PAGE_CNT contiguous pages off POOL's free lists and
+   returns the index of the first one, or BITMAP_ERROR if no
+   free block is big enough.  The pages come from the smallest
+   free block of at least PAGE_CNT pages; the rest of that block
+   goes back on the free lists. */
+static size_t
+allocate_block (struct pool *pool, size_t page_cnt)
+{
+  int need = 0, order;
+  size_t page_idx;
+
+  while (((size_t) 1 << need) < page_cnt)
+    if (++need >= ORDER_CNT)
+      return BITMAP_ERROR;
+
+  for (order = need; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  if (order >= ORDER_CNT)
+    return BITMAP_ERROR;
+
+  page_idx = elem_page (pool, list_pop_front (&pool->free_lists[order]));
+  pool->free_order[page_idx] = 0;
+
+  /* Split off upper halves until the block is just big enough,
+     then give back the pages past PAGE_CNT. */
+  while (order > need)
+    {
+      order--;
+      push_block (pool, page_idx + ((size_t) 1 << order), order);
+    }
+  free_range (pool, page_idx + page_cnt, ((size_t) 1 << need) - page_cnt);
+  return page_idx;
+}
+
+/* Returns a free page from POOL's cache and marks
+   it used, first refilling the cache from the buddy allocator if
+   it is empty.  Returns a null pointer if POOL has no free page.
+   Interrupts must be off. */
+static void *
+cache_get_page (struct pool *pool)
+{
+  struct page_cache *c = &pool->cache;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (c->page_cnt > 0)
+    c->hits++;
+  else
+    {
+      c->misses++;
+      while (c->page_cnt < CACHE_BATCH)
+        {
+          size_t page_idx = allocate_block (pool, 1);
+          if (page_idx == BITMAP_ERROR)
+            break;
+          bitmap_mark (pool->used_map, page_idx);
+          c->pages[c->page_cnt++] = pool->base + PGSIZE * page_idx;
+        }
+      if (c->page_cnt == 0)
+        return NULL;
+    }
+  return c->pages[--c->page_cnt];
+}
+
+/* Puts PAGE, a single page from POOL, into POOL's cache, first
+   draining part of the cache to the buddy allocator
+   if it is full.  Interrupts must be off. */
+static void
+cache_free_page (struct pool *pool, void *page)
+{
+  struct page_cache *c = &pool->cache;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (c->page_cnt == CACHE_PAGES)
+    cache_drain (pool, CACHE_BATCH);
+  c->pages[c->page_cnt++] = page;
+}
+
+#ifndef NDEBUG
+/* Returns true if PAGE is sitting free in POOL's page cache.
+   Interrupts must be off. */
+static bool
+page_cached (const struct pool *pool, void *page)
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < pool->cache.page_cnt; i++)
+    if (pool->cache.pages[i] == page)
+      return true;
+  return false;
+}
+#endif
+
+/* Gives the CNT pages at the bottom of POOL's cache back to the
+   buddy allocator.  The bottom pages have been in the cache
+   longest.  Interrupts must be off. */
+static void
+cache_drain (struct pool *pool, size_t cnt)
+{
+  struct page_cache *c = &pool->cache;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cnt <= c->page_cnt);
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t page_idx = pg_no (c->pages[i]) - pg_no (pool->base);
+      bitmap_reset (pool->used_map, page_idx);
+      free_range (pool, page_idx, 1);
+    }
+  c->page_cnt -= cnt;
+  memmove (c->pages, c->pages + cnt, c->page_cnt * sizeof *c->pages);
+}
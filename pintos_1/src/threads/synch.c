@@ -30,8 +30,11 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/thread.h"
 
+static void preempt_for (int priority);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -107,16 +110,17 @@ sema_try_down (struct semaphore *sema)
 
    This function may be called from an interrupt handler. */
 
-/* 먼저 세마포어의 웨이터에서 쓰레드를 꺼내기전에 맨앞에 있는 쓰레드가 가장 큰  priority를 가진 쓰레드라는 것을 확정하기 위해 sorting시켰습니다. 그리고 pop을 이용하여 쓰레드를 꺼낸후 unblock시켰습니다.*/ 
+/* 먼저 세마포어의 웨이터에서 쓰레드를 꺼내기전에 맨앞에 있는 쓰레드가 가장 큰  priority를 가진 쓰레드라는 것을 확정하기 위해 sorting시켰습니다. 그리고 pop을 이용하여 쓰레드를 꺼낸후 unblock시켰습니다.
+   깨운 쓰레드가 현재 쓰레드보다 priority가 높을 때만 양보하므로, 기다리는 쓰레드가 없으면 스케쥴러를 부르지 않습니다.*/ 
 
 void
 sema_up (struct semaphore *sema) 
 {
   enum intr_level old_level;
+  struct thread *t1 = NULL;
 
   ASSERT (sema != NULL);
   old_level = intr_disable ();
-  struct thread * t1;
   if (!list_empty (&sema->waiters)) 
   {
     list_sort(&(sema->waiters), high_pri, NULL);
@@ -125,8 +129,25 @@ sema_up (struct semaphore *sema)
   }
   
   sema->value++;
+  if (t1 != NULL)
+    preempt_for (t1->priority);
   intr_set_level (old_level);
-  thread_yield();
+}
+
+/* 방금 깨운 쓰레드의 priority PRIORITY가 현재 쓰레드보다 높으면 CPU를 양보합니다.
+   인터럽트 핸들러 안에서는 바로 양보할 수 없으므로 핸들러가 끝날 때 양보합니다.
+   인터럽트가 꺼진 상태에서 호출되어야 합니다. */
+static void
+preempt_for (int priority) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (priority <= thread_current ()->priority)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else
+    thread_yield ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -187,9 +208,36 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->max_priority = PRI_MIN;
   sema_init (&lock->semaphore, 1);
 }
 
+/* 현재 스레드를 LOCK의 holder로 만들고 held_locks에 LOCK을 넣습니다.
+   아직 LOCK을 기다리고 있는 스레드들의 priority 중 가장 큰 값을
+   max_priority로 다시 계산하여, 남은 waiter들의 도네이션이 새 holder에게
+   이어지도록 합니다. 인터럽트가 꺼진 상태에서 호출되어야 합니다. */
+static void
+lock_take (struct lock *lock) 
+{
+  struct thread *cur = thread_current ();
+  struct list *waiters = &lock->semaphore.waiters;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  lock->max_priority = PRI_MIN;
+  for (e = list_begin (waiters); e != list_end (waiters); e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, elem);
+      if (t->priority > lock->max_priority)
+        lock->max_priority = t->priority;
+    }
+  list_push_back (&cur->held_locks, &lock->elem);
+  if (!thread_mlfqs && lock->max_priority > cur->priority)
+    thread_refresh_priority (cur);
+}
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
@@ -199,27 +247,29 @@ lock_init (struct lock *lock)
    interrupts disabled, but interrupts will be turned back on if
    we need to sleep. */
 
-/* mlfqs가 맞는 경우에는 기존의 lock acquire과정을 진행합니다. 아닌 경우에는 lock의 holder가 존재하면 기다리고 있는 lock을 가리키는 lock_pointing을 먼저 업데이트하고 도네이션을 진행합니다. 그리고 lock holder의 dona_list에 자신의 dona_elem을 삽입합니다. 그 후 기존의 lock과 동일하게 진행합니다.*/
+/* mlfqs가 맞는 경우에는 기존의 lock acquire과정을 진행합니다. 아닌 경우에는 lock의 holder가 존재하면 기다리고 있는 lock을 가리키는 lock_pointing을 먼저 업데이트하고 도네이션을 진행합니다. 도네이션은 lock의 max_priority에 기록되므로 holder쪽에 따로 리스트를 관리하지 않습니다. 그 후 기존의 lock과 동일하게 진행하고, 얻은 lock을 held_locks에 넣습니다.*/
 
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
-  if(!thread_mlfqs)
-{
-  if(lock->holder != NULL)
-  { 
-	thread_current()->lock_pointing = lock;
-        donate_priority();
-        struct list * l1 = &lock->holder->dona_list;
-        list_push_front(l1,&thread_current()->dona_elem);
-  }
-}
+
+  if (!thread_mlfqs && lock->holder != NULL)
+    {
+      cur->lock_pointing = lock;
+      donate_priority (cur);
+    }
   sema_down (&lock->semaphore);
-  thread_current()->lock_pointing=NULL;
-  lock->holder = thread_current();
+
+  old_level = intr_disable ();
+  cur->lock_pointing = NULL;
+  lock_take (lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -231,14 +281,17 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    lock_take (lock);
+  intr_set_level (old_level);
   return success;
 }
 
@@ -248,45 +301,23 @@ lock_try_acquire (struct lock *lock)
    make sense to try to release a lock within an interrupt
    handler. */
 
-  /*이 역시 mlfqs인지 확인해서 맞으면 기존의 lock_release()를 진행합니다. 만약 아니라면 priority donation을 제거하고 새로 갱신해줍니다. */
+  /*이 역시 mlfqs인지 확인해서 맞으면 기존의 lock_release()를 진행합니다. 만약 아니라면 held_locks에서 lock을 빼고 남은 lock들의 max_priority로 priority를 새로 갱신해줍니다. 가지고 있는 lock의 개수만큼만 시간이 걸립니다. */
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
- enum intr_level old_level;
- old_level = intr_disable();
- lock->holder = NULL;
- 
- if(!thread_mlfqs)
-{
-  struct thread * t1 = thread_current();
-  struct thread * t2;
-  struct list * l1 = &lock->semaphore.waiters;
-  struct list * l2 = &t1->dona_list;
-  struct list_elem * e1 = list_begin(l1); 
-  
-  while(e1 != list_end(l1))
- { t2 = list_entry(e1,struct thread,elem);
-   list_remove(&t2->dona_elem);
-   e1 = list_next(e1);
- }
-  if(list_empty(l2))
-  { 
-  t1->priority = t1->priority_inst;
-  }
-  else 
-  { list_sort(l2,high_pri,NULL);
-    e1 = list_begin(l2);
-    t2 = list_entry(e1,struct thread,dona_elem);
-    if(t2->priority > t1->priority_inst)
-    t1->priority = t2->priority;
-    else
-    t1->priority = t1->priority_inst;
-  }
- } 
+
+  old_level = intr_disable ();
+  lock->holder = NULL;
+  list_remove (&lock->elem);
+  lock->max_priority = PRI_MIN;
+  if (!thread_mlfqs)
+    thread_refresh_priority (thread_current ());
   sema_up (&lock->semaphore);
- intr_set_level(old_level);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -408,3 +439,303 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* A thread waiting on an rwlock. */
+/* 기다리는 쓰레드의 스택에 놓이며, rwlock을 넘겨주는 쪽이 리스트에서 뺍니다. */
+struct rwlock_waiter
+  {
+    struct list_elem elem;              /* Element in rwlock's waiters. */
+    struct rwlock_hold *hold;           /* Hold record for the thread. */
+    bool writer;                        /* Waiting for write access? */
+  };
+
+static struct rwlock_hold *rwlock_hold_get (struct rwlock *);
+static void rwlock_grant (struct rwlock *, struct rwlock_hold *, bool writer);
+static void rwlock_wait (struct rwlock *, struct rwlock_hold *, bool writer);
+static void rwlock_donate (struct rwlock *, int priority);
+static void rwlock_release (struct rwlock *, bool writer);
+static int rwlock_handoff (struct rwlock *);
+
+/* Initializes readers-writer lock RW.  Any number of readers
+   may hold RW at once, or a single writer may hold it alone.
+   Writers are preferred: once a writer is waiting, new readers
+   wait behind it.  Threads waiting on RW donate their priority
+   to every thread currently holding it, reader or writer. */
+void
+rwlock_init (struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  list_init (&rw->holders);
+  rw->readers = 0;
+  rw->writing = false;
+  list_init (&rw->waiters);
+  rw->waiting_writers = 0;
+  rw->max_priority = PRI_MIN;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds or
+   is waiting for it.  The current thread must not already hold
+   RW.  Taking an uncontended RW makes no scheduler calls. */
+void
+rwlock_acquire_read (struct rwlock *rw) 
+{
+  struct rwlock_hold *hold;
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  hold = rwlock_hold_get (rw);
+  old_level = intr_disable ();
+  if (!rw->writing && rw->waiting_writers == 0)
+    rwlock_grant (rw, hold, false);
+  else
+    rwlock_wait (rw, hold, false);
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for
+   reading. */
+void
+rwlock_release_read (struct rwlock *rw) 
+{
+  rwlock_release (rw, false);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.  The current thread must not already hold RW. */
+void
+rwlock_acquire_write (struct rwlock *rw) 
+{
+  struct rwlock_hold *hold;
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  hold = rwlock_hold_get (rw);
+  old_level = intr_disable ();
+  if (!rw->writing && rw->readers == 0)
+    rwlock_grant (rw, hold, true);
+  else
+    rwlock_wait (rw, hold, true);
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for
+   writing. */
+void
+rwlock_release_write (struct rwlock *rw) 
+{
+  rwlock_release (rw, true);
+}
+
+/* 현재 쓰레드가 RW를 잡을 때 쓸 rwlock_hold를 준비합니다. struct thread
+   안의 빈 칸을 먼저 쓰고, 모두 쓰이고 있으면 malloc()으로 받습니다.
+   칸을 고르는 것은 그 쓰레드 자신뿐이므로 인터럽트를 끌 필요가 없습니다. */
+static struct rwlock_hold *
+rwlock_hold_get (struct rwlock *rw) 
+{
+  struct thread *cur = thread_current ();
+  struct rwlock_hold *hold = NULL;
+  struct list_elem *e;
+  int i;
+
+  for (e = list_begin (&cur->rw_holds); e != list_end (&cur->rw_holds);
+       e = list_next (e))
+    ASSERT (list_entry (e, struct rwlock_hold, thread_elem)->rwlock != rw);
+
+  for (i = 0; i < RWLOCK_HOLD_SLOTS; i++)
+    if (cur->rw_hold_slots[i].rwlock == NULL)
+      {
+        hold = &cur->rw_hold_slots[i];
+        hold->allocated = false;
+        break;
+      }
+  if (hold == NULL)
+    {
+      hold = malloc (sizeof *hold);
+      if (hold == NULL)
+        PANIC ("out of memory for rwlock hold records");
+      hold->allocated = true;
+    }
+  hold->rwlock = rw;
+  hold->thread = cur;
+  return hold;
+}
+
+/* HOLD의 쓰레드를 RW의 holder로 등록합니다.
+   인터럽트가 꺼진 상태에서 호출되어야 합니다. */
+static void
+rwlock_grant (struct rwlock *rw, struct rwlock_hold *hold, bool writer) 
+{
+  struct thread *t = hold->thread;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (hold->rwlock == rw);
+
+  list_push_back (&rw->holders, &hold->elem);
+  list_push_back (&t->rw_holds, &hold->thread_elem);
+  t->rwlock_pointing = NULL;
+  if (writer)
+    rw->writing = true;
+  else
+    rw->readers++;
+  if (!thread_mlfqs)
+    thread_raise_priority (t, rw->max_priority);
+}
+
+/* 현재 쓰레드를 RW의 waiters에 넣고 holder들에게 도네이션한 후 잠듭니다.
+   rwlock_pointing을 남겨 두므로 나중에 이 쓰레드에게 도네이션하는 쓰레드도
+   RW의 holder들까지 따라 올라갑니다. 깨어났을 때는 rwlock_handoff()가
+   이미 RW를 넘겨준 상태입니다. */
+static void
+rwlock_wait (struct rwlock *rw, struct rwlock_hold *hold, bool writer) 
+{
+  struct rwlock_waiter waiter;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  waiter.hold = hold;
+  waiter.writer = writer;
+  list_push_back (&rw->waiters, &waiter.elem);
+  if (writer)
+    rw->waiting_writers++;
+  hold->thread->rwlock_pointing = rw;
+  if (!thread_mlfqs)
+    donate_priority (hold->thread);
+  thread_block ();
+}
+
+/* RW의 max_priority를 PRIORITY 이상으로 올리고 모든 holder들에게
+   도네이션합니다. holder가 다른 lock이나 rwlock을 기다리고 있다면 그것을 따라
+   nested donation도 진행합니다. */
+static void
+rwlock_donate (struct rwlock *rw, int priority) 
+{
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (rw->max_priority < priority)
+    rw->max_priority = priority;
+  for (e = list_begin (&rw->holders); e != list_end (&rw->holders);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct rwlock_hold, elem)->thread;
+      if (t->priority < rw->max_priority)
+        {
+          thread_raise_priority (t, rw->max_priority);
+          donate_priority (t);
+        }
+    }
+}
+
+/* 현재 쓰레드가 잡고 있는 RW를 놓습니다. 마지막 holder였다면 기다리는
+   쓰레드들에게 RW를 넘겨주고, 그 중 현재 쓰레드보다 priority가 높은
+   쓰레드가 있으면 양보합니다. */
+static void
+rwlock_release (struct rwlock *rw, bool writer) 
+{
+  struct thread *cur = thread_current ();
+  struct rwlock_hold *hold = NULL;
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  for (e = list_begin (&cur->rw_holds); e != list_end (&cur->rw_holds);
+       e = list_next (e))
+    if (list_entry (e, struct rwlock_hold, thread_elem)->rwlock == rw)
+      {
+        hold = list_entry (e, struct rwlock_hold, thread_elem);
+        break;
+      }
+  ASSERT (hold != NULL);
+  ASSERT (writer ? rw->writing : rw->readers > 0);
+
+  list_remove (&hold->elem);
+  list_remove (&hold->thread_elem);
+  hold->rwlock = NULL;
+  if (writer)
+    rw->writing = false;
+  else
+    rw->readers--;
+
+  if (!thread_mlfqs)
+    thread_refresh_priority (cur);
+  if (!rw->writing && rw->readers == 0)
+    preempt_for (rwlock_handoff (rw));
+  intr_set_level (old_level);
+
+  if (hold->allocated)
+    free (hold);
+}
+
+/* 아무도 잡고 있지 않은 RW를 기다리는 쓰레드에게 넘겨줍니다. writer가
+   기다리고 있다면 그 중 priority가 가장 높은 writer 하나에게, 아니라면
+   기다리는 모든 reader에게 넘겨줍니다. 남은 waiter들로 max_priority를
+   다시 계산하고, 깨운 쓰레드들 중 가장 높은 priority를 리턴합니다. */
+static int
+rwlock_handoff (struct rwlock *rw) 
+{
+  struct list_elem *e, *next;
+  int woken_priority = PRI_MIN - 1;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (rw->waiting_writers > 0)
+    {
+      struct rwlock_waiter *best = NULL;
+
+      for (e = list_begin (&rw->waiters); e != list_end (&rw->waiters);
+           e = list_next (e))
+        {
+          struct rwlock_waiter *w = list_entry (e, struct rwlock_waiter, elem);
+          if (w->writer
+              && (best == NULL
+                  || w->hold->thread->priority > best->hold->thread->priority))
+            best = w;
+        }
+      list_remove (&best->elem);
+      rw->waiting_writers--;
+      rw->max_priority = PRI_MIN;
+      rwlock_grant (rw, best->hold, true);
+      woken_priority = best->hold->thread->priority;
+      thread_unblock (best->hold->thread);
+    }
+  else
+    {
+      rw->max_priority = PRI_MIN;
+      for (e = list_begin (&rw->waiters); e != list_end (&rw->waiters);
+           e = next)
+        {
+          struct rwlock_waiter *w = list_entry (e, struct rwlock_waiter, elem);
+
+          next = list_remove (e);
+          rwlock_grant (rw, w->hold, false);
+          if (w->hold->thread->priority > woken_priority)
+            woken_priority = w->hold->thread->priority;
+          thread_unblock (w->hold->thread);
+        }
+    }
+
+  /* Threads still waiting behind the new holders keep donating. */
+  if (!thread_mlfqs && !list_empty (&rw->waiters))
+    {
+      int max_priority = PRI_MIN;
+
+      for (e = list_begin (&rw->waiters); e != list_end (&rw->waiters);
+           e = list_next (e))
+        {
+          struct rwlock_waiter *w = list_entry (e, struct rwlock_waiter, elem);
+          if (w->hold->thread->priority > max_priority)
+            max_priority = w->hold->thread->priority;
+        }
+      rwlock_donate (rw, max_priority);
+    }
+  return woken_priority;
+}
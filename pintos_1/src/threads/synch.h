@@ -22,6 +22,10 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    /* holder의 held_locks 리스트를 위한 list_elem입니다. */
+    struct list_elem elem;
+    /* 이 lock을 기다리는 스레드들 중 가장 높은 priority입니다. */
+    int max_priority;
   };
 
 void lock_init (struct lock *);
@@ -41,6 +45,26 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 bool cond_high_pri(struct list_elem *a,struct list_elem *b,void * aux);
+
+/* Readers-writer lock. */
+/* 여러 reader가 동시에 잡거나 writer 하나가 혼자 잡을 수 있는 lock입니다.
+   writer가 기다리고 있으면 새로운 reader는 기다리므로 writer가 굶지 않습니다. */
+struct rwlock
+  {
+    struct list holders;        /* rwlock_hold of each holding thread. */
+    int readers;                /* # of readers holding the lock. */
+    bool writing;               /* True if a writer holds the lock. */
+    struct list waiters;        /* Waiting threads (rwlock_waiter). */
+    int waiting_writers;        /* # of writers in WAITERS. */
+    int max_priority;           /* Highest priority among WAITERS. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
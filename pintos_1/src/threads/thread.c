@@ -12,6 +12,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -21,9 +22,19 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* donate_priority()가 따라 올라가는 nested donation의 최대 깊이입니다. */
+#define DONATION_DEPTH 8
+
+/* Lists of processes in THREAD_READY state, that is, processes
+   that are ready to run but not actually running.  There is one
+   list per priority level. */
+/* priority마다 FIFO 큐를 하나씩 두고, 비어있지 않은 큐를 ready_bitmap의
+   비트로 표시합니다. 삽입/삭제는 O(1)이고 다음 스레드는 가장 높은 비트를
+   찾아서 고릅니다. */
+#define READY_QUEUE_CNT (PRI_MAX - PRI_MIN + 1)
+static struct list ready_queues[READY_QUEUE_CNT];
+static uint64_t ready_bitmap;   /* Bit P set iff ready_queues[P] nonempty. */
+static size_t ready_cnt;        /* # of threads in the ready queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -61,6 +72,32 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 int load_avg;
+
+/* 1초마다 증가하는 mlfqs 갱신 횟수입니다. 각 스레드는 자신의 recent_cpu가
+   몇 번째 갱신까지 반영되었는지를 recent_cpu_epoch에 기억합니다. */
+static int mlfqs_epoch;
+/* 최근 MLFQS_DECAY_HISTORY번의 갱신 결과를 epoch % MLFQS_DECAY_HISTORY
+   위치에 기록합니다. 매초 recent_cpu는 r' = d*r + nice (d는 그 초의 감쇠
+   계수 (2*load_avg)/(2*load_avg+1))로 바뀌므로, epoch A에서 B까지 밀린
+   갱신은 r_B = P*(r_A - nice*G_A) + nice*G_B로 한 번에 계산할 수 있습니다.
+   여기서 P = C_B / C_A는 그 사이 계수들의 곱이고, C_E는 계수들의 누적곱,
+   G_E는 nice가 1이고 r이 0에서 시작한 가상의 스레드가 epoch E에 가질
+   recent_cpu입니다. 누적곱은 금방 17.14 고정소수점의 범위 밖으로 작아지므로
+   정규화된 64비트 가수와 지수로 저장합니다. 계수가 0이면 그 뒤의 값은
+   이전 값과 상관없어지므로 누적곱과 G를 그 epoch부터 다시 셉니다.
+   이 기록보다 오래된 감쇠는 이미 recent_cpu에 거의 영향을 주지 않으므로
+   생략합니다. */
+#define MLFQS_DECAY_HISTORY 1024
+struct mlfqs_decay
+  {
+    uint64_t prod_mant;         /* C_E = prod_mant * 2^-prod_exp, */
+    int prod_exp;               /* with prod_mant in [2^62, 2^63). */
+    int64_t unit;               /* G_E, with 32 fraction bits. */
+  };
+static struct mlfqs_decay mlfqs_decay[MLFQS_DECAY_HISTORY];
+/* 감쇠 계수가 마지막으로 0이었던 epoch입니다. */
+static int mlfqs_reset_epoch;
+static void mlfqs_record_decay (int decay);
 void mlfqs_priority(struct thread * t);
 void mlfqs_recent_cpu(struct thread * t);
 void mlfqs_load_avg(void);
@@ -77,6 +114,11 @@ static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static void thread_change_priority (struct thread *, int priority);
+static void donate_from (struct thread *, int depth);
 static tid_t allocate_tid (void);
 
 /* Initializes the threading system by transforming the code
@@ -95,10 +137,15 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i < READY_QUEUE_CNT; i++)
+    list_init (&ready_queues[i]);
+  ready_bitmap = 0;
+  ready_cnt = 0;
   list_init (&all_list);
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -117,6 +164,7 @@ thread_start (void)
   sema_init (&idle_started, 0);
   thread_create ("idle", PRI_MIN, idle, &idle_started);
   load_avg = 0;
+  mlfqs_decay[0].prod_mant = (uint64_t) 1 << 62;
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
@@ -141,8 +189,10 @@ thread_tick (void)
   else
     kernel_ticks++;
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  /* Enforce preemption.  timer_idle_exit() also calls us outside
+     of interrupt context, from the idle thread, which is about to
+     give up the CPU anyway. */
+  if (++thread_ticks >= TIME_SLICE && intr_context ())
     intr_yield_on_return ();
 }
 
@@ -234,6 +284,8 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  if (thread_current () == idle_thread)
+    timer_idle_exit ();
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -247,7 +299,8 @@ thread_block (void)
    it may expect that it can atomically unblock a thread and
    update other data. */
 
-/* priority순서에 맞춰서 ready list에 삽입되도록 변경되었습니다.
+/* 자신의 priority에 해당하는 ready queue의 뒤에 삽입됩니다.
+mlfqs라면 잠들어 있는 동안 밀린 recent_cpu 감쇠를 먼저 반영하고 priority를 다시 계산합니다.
 인터럽트는 이 과정에서 허용되지 않습니다. */
 void
 thread_unblock (struct thread *t) 
@@ -258,7 +311,12 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_insert_ordered(&ready_list,&t->elem,high_pri,NULL);
+  if (thread_mlfqs)
+    {
+      mlfqs_recent_cpu (t);
+      mlfqs_priority (t);
+    }
+  ready_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -329,7 +387,7 @@ thread_exit (void)
 
 /* Yields the CPU.  The current thread is not put to sleep and
    may be scheduled again immediately at the scheduler's whim. */
-/* thread를 양보할 때  ready_list priority순서로 insert를 진행합니다. 그 후 스케쥴을 진행하여 cpu를 차지할 다음 thread를 선정합니다.*/
+/* thread를 양보할 때 자신의 priority에 해당하는 ready queue에 insert를 진행합니다. 그 후 스케쥴을 진행하여 cpu를 차지할 다음 thread를 선정합니다.*/
 void
 thread_yield (void) 
 {
@@ -339,8 +397,10 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread) 
-    list_insert_ordered(&ready_list,&cur->elem,high_pri,NULL);
+  if (cur == idle_thread)
+    timer_idle_exit ();
+  else
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -365,62 +425,135 @@ thread_foreach (thread_action_func *func, void *aux)
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
 /* 만약 mlfqs라면 실행을 하지 않습니다. (timer_interrupt에서 계산됨)
-아니라면 해당 쓰레드의 실질적인 priority를 new priority로 바꿔주고 바뀐 priority로 존재한다면 donation을 진행합니다. 만약 자기가 가지고 있는 donation list가 비었거나 실질적인 priority가 낮다면 new priority가 priority로 바뀝니다. 그 후 ready_list의 priority와 비교해서 낮으면 cpu를 포기합니다. */
+아니라면 해당 쓰레드의 실질적인 priority를 new priority로 바꿔주고, 가지고 있는 lock들에 기부된 priority와 비교하여 priority를 다시 정합니다. 그 후 ready queue의 가장 높은 priority와 비교해서 낮으면 cpu를 포기합니다. */
 void
 thread_set_priority (int new_priority) 
 {
-  if(thread_mlfqs)
-  return;
-
-  struct list * d1 = &thread_current()->dona_list;
-  struct thread * t1; 
-   
-  thread_current()->priority_inst = new_priority;
-  if(!list_empty(d1))
- { list_sort(d1,high_pri,NULL);
-   t1 = list_entry(list_begin(d1),struct thread,dona_elem);
-   if(t1->priority > thread_current()->priority_inst)
-  thread_current()->priority = t1->priority;
-   else
-  thread_current()->priority = thread_current()->priority_inst;
- }
-  else 
-  thread_current()->priority = thread_current()->priority_inst;   
- if(!list_empty(&ready_list))
- {  list_sort(&ready_list,high_pri,NULL);
-   
-    if(thread_current()->priority < list_entry(list_front(&ready_list),struct thread,elem)->priority)
-  {
-   thread_yield();
-  }
- } 
+  struct thread *cur = thread_current ();
+
+  if (thread_mlfqs)
+    return;
+
+  cur->priority_inst = new_priority;
+  thread_refresh_priority (cur);
+  if (cur->priority < ready_max_priority ())
+    thread_yield ();
 }
 
-/* t가 idle thread가 아니라면 지금 priority를 계산하여 갱신합니다.*/
-void mlfqs_priority(struct thread * t)
+/* T의 priority를 priority_inst와 T가 가지고 있는 lock, rwlock들의 max_priority 중
+   가장 큰 값으로 다시 정합니다. 가지고 있는 lock의 개수만큼만 시간이 걸립니다. */
+void
+thread_refresh_priority (struct thread *t) 
 {
- if(t == idle_thread)
- return;
-  t-> priority = PRI_MAX - fixed_to_int_round(t->recent_cpu/4) - (t->nice)*2;
- 
+  int priority = t->priority_inst;
+  enum intr_level old_level;
+  struct list_elem *e;
 
+  old_level = intr_disable ();
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      if (lock->max_priority > priority)
+        priority = lock->max_priority;
+    }
+  for (e = list_begin (&t->rw_holds); e != list_end (&t->rw_holds);
+       e = list_next (e))
+    {
+      struct rwlock *rwlock
+        = list_entry (e, struct rwlock_hold, thread_elem)->rwlock;
+      if (rwlock->max_priority > priority)
+        priority = rwlock->max_priority;
+    }
+  thread_change_priority (t, priority);
+  intr_set_level (old_level);
 }
-/*fp 함수를 이용하여 recent_cpu를 갱신합니다.*/
+
+/* t가 idle thread가 아니라면 지금 priority를 계산하여 갱신합니다.
+   계산 결과는 PRI_MIN..PRI_MAX 범위로 잘라서 ready queue의 인덱스로 쓸 수 있게 합니다.*/
+void mlfqs_priority(struct thread * t)
+{
+  int priority;
+
+  if (t == idle_thread)
+    return;
+  priority = PRI_MAX - fixed_to_int_round (t->recent_cpu / 4) - t->nice * 2;
+  if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  else if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  thread_change_priority (t, priority);
+}
+/*fp 함수를 이용하여 recent_cpu를 갱신합니다.
+  t->recent_cpu_epoch 이후로 밀린 감쇠를 mlfqs_decay의 누적값으로 한 번에
+  적용하므로, 몇 초가 밀렸든 걸리는 시간이 같습니다. 이미 최신 상태인
+  스레드에 대해서는 아무 일도 하지 않습니다.*/
 void mlfqs_recent_cpu(struct thread * t)
 { 
- if(t == idle_thread)
- return;
- else
- { 
-   int k = fixed_div(2*load_avg,fixed_int_add(2*load_avg,1));
-   t->recent_cpu = fixed_int_add(fixed_mul(k,t->recent_cpu) ,t->nice);
- }
+  const struct mlfqs_decay *a, *b;
+  int epoch = t->recent_cpu_epoch;
+  int64_t base;
+  uint64_t ratio;
+  int shift;
+
+  if (t == idle_thread || epoch == mlfqs_epoch)
+    return;
+
+  if (epoch < mlfqs_reset_epoch)
+    {
+      /* 0인 계수에서 recent_cpu는 nice가 됩니다. */
+      t->recent_cpu = int_to_fixed (t->nice);
+      epoch = mlfqs_reset_epoch;
+    }
+  if (mlfqs_epoch - epoch >= MLFQS_DECAY_HISTORY)
+    epoch = mlfqs_epoch - MLFQS_DECAY_HISTORY + 1;
+
+  a = &mlfqs_decay[epoch % MLFQS_DECAY_HISTORY];
+  b = &mlfqs_decay[mlfqs_epoch % MLFQS_DECAY_HISTORY];
+
+  /* P를 2.30 고정소수점으로 구합니다. */
+  ratio = b->prod_mant / (a->prod_mant >> 31);
+  shift = b->prod_exp - a->prod_exp + 1;
+  ratio = shift < 64 ? ratio >> shift : 0;
+
+  base = t->recent_cpu - ((t->nice * a->unit) >> 18);
+  t->recent_cpu = ((base * (int64_t) ratio) >> 30) + ((t->nice * b->unit) >> 18);
+  t->recent_cpu_epoch = mlfqs_epoch;
 }
+
+/* 새 epoch의 감쇠 계수 DECAY를 mlfqs_decay에 기록합니다. 이전 epoch의
+   누적값에서 상수 시간에 계산합니다. */
+static void
+mlfqs_record_decay (int decay)
+{
+  const struct mlfqs_decay *prev
+    = &mlfqs_decay[(mlfqs_epoch - 1) % MLFQS_DECAY_HISTORY];
+  struct mlfqs_decay *cur = &mlfqs_decay[mlfqs_epoch % MLFQS_DECAY_HISTORY];
+
+  if (decay == 0)
+    {
+      mlfqs_reset_epoch = mlfqs_epoch;
+      cur->prod_mant = (uint64_t) 1 << 62;
+      cur->prod_exp = 0;
+      cur->unit = (int64_t) 1 << 32;
+      return;
+    }
+
+  cur->prod_mant = (prev->prod_mant >> 14) * decay;
+  cur->prod_exp = prev->prod_exp;
+  while (cur->prod_mant < (uint64_t) 1 << 62)
+    {
+      cur->prod_mant <<= 1;
+      cur->prod_exp++;
+    }
+  cur->unit = ((prev->unit * decay) >> 14) + ((int64_t) 1 << 32);
+}
+
 /* fp함수를 이용하여 주어진 대로 load_avg 값을 계산합니다.*/
 void mlfqs_load_avg(void)
 { 
 int n ;
-n = list_size(&ready_list);
+n = ready_cnt;
 if(thread_current()!=idle_thread)
 n = n+1;
 load_avg = fixed_mul(int_to_fixed(59)/60,load_avg)+int_to_fixed(1)/60*n;
@@ -437,17 +570,37 @@ void mlfqs_increment(void)
   thread_current()->recent_cpu = fixed_int_add(thread_current()->recent_cpu,1);
 
 }
- /* 모든 thread들의 priority를 다시 계산합니다. */
+ /* 1초마다 호출되어 이번 초의 감쇠 계수를 기록하고, 현재 스레드와 ready 상태의
+    스레드들의 recent_cpu와 priority만 다시 계산합니다. block된 스레드는
+    thread_unblock()에서 밀린 만큼 한꺼번에 계산됩니다.
+    priority가 바뀐 스레드는 ready queue를 옮겨가는데, 이미 갱신된 스레드를
+    다시 만나더라도 epoch가 같으므로 아무 일도 일어나지 않습니다. */
 void mlfqs_recalc(void)
 {
- struct list_elem * e1 = list_begin(&all_list);
- struct thread * t1 = list_entry(e1,struct thread,allelem);
- while(e1 != list_end(&all_list))
- {mlfqs_recent_cpu(t1);
-  mlfqs_priority(t1);
-  e1 = list_next(e1);
-  t1 = list_entry(e1,struct thread,allelem);
- }
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  mlfqs_epoch++;
+  mlfqs_record_decay (fixed_div (2 * load_avg,
+                                 fixed_int_add (2 * load_avg, 1)));
+
+  mlfqs_recent_cpu (thread_current ());
+  mlfqs_priority (thread_current ());
+  for (i = 0; i < READY_QUEUE_CNT; i++)
+    {
+      struct list *q = &ready_queues[i];
+      struct list_elem *e, *next;
+
+      for (e = list_begin (q); e != list_end (q); e = next)
+        {
+          struct thread *t = list_entry (e, struct thread, elem);
+
+          next = list_next (e);
+          mlfqs_recent_cpu (t);
+          mlfqs_priority (t);
+        }
+    }
 }
 
 /* Returns the current thread's priority. */
@@ -469,8 +622,9 @@ thread_set_nice (int nice)
  t1->nice = nice;
  mlfqs_recent_cpu(t1);
  mlfqs_priority(t1);
- list_sort(&ready_list,high_pri,NULL);
  intr_set_level(old_level); 
+ if (t1->priority < ready_max_priority ())
+   thread_yield ();
 } 
 
 /* Returns the current thread's nice value. */
@@ -497,23 +651,77 @@ thread_get_load_avg (void)
 }
 
 /* priority를 도네이션하는 함수입니다. 
-nest donation을 하는 함수이며 lock을 가지고 있는 상위 thread가 
-priority가 더 크면 멈추고 작다면 계속 위로 올라가면서 
-priority를 갱신해줍니다. */
-void donate_priority(void)
-{
-  struct thread * t1;
-  struct thread * t2;
-  t2 = thread_current();
-  t1 = t2->lock_pointing->holder;
-        while(t1->priority < t2->priority)
-        {  t1->priority = t2->priority;
-           if(t1->lock_pointing==NULL)
-           break;
-           t2=t1;
-           t1=t2->lock_pointing->holder;
+nest donation을 하는 함수이며 기다리는 lock의 max_priority를 올리고,
+lock을 가지고 있는 상위 thread가 priority가 더 크면 멈추고 작다면 
+계속 위로 올라가면서 priority를 갱신해줍니다.
+T부터 시작하여 T가 기다리는 lock이나 rwlock을 따라 올라갑니다.
+rwlock은 holder가 여럿일 수 있으므로, 첫 holder는 이 루프에서 따라가고
+나머지 holder들은 재귀로 따라갑니다.
+한 단계마다 인터럽트를 껐다가 다시 켜므로 체인 전체 동안 인터럽트가 꺼져 있지 않고,
+각 단계에서는 그 순간의 lock_pointing, rwlock_pointing과 holder를 다시 읽습니다.
+최대 DONATION_DEPTH 단계까지만 올라갑니다. */
+void donate_priority(struct thread *t)
+{
+  donate_from (t, 0);
+}
+
+static void
+donate_from (struct thread *t, int depth)
+{
+  for (; depth < DONATION_DEPTH; depth++)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct lock *lock = t->lock_pointing;
+      struct rwlock *rwlock = t->rwlock_pointing;
+      struct thread *next = NULL;
+
+      if (lock != NULL)
+        {
+          struct thread *holder = lock->holder;
+
+          if (lock->max_priority < t->priority)
+            lock->max_priority = t->priority;
+          if (holder != NULL && holder->priority < t->priority)
+            {
+              thread_change_priority (holder, t->priority);
+              next = holder;
+            }
+        }
+      else if (rwlock != NULL)
+        {
+          struct list_elem *e;
+
+          if (rwlock->max_priority < t->priority)
+            rwlock->max_priority = t->priority;
+          for (e = list_begin (&rwlock->holders);
+               e != list_end (&rwlock->holders); e = list_next (e))
+            {
+              struct thread *holder
+                = list_entry (e, struct rwlock_hold, elem)->thread;
+
+              if (holder->priority >= t->priority)
+                continue;
+              thread_change_priority (holder, t->priority);
+              if (next == NULL)
+                next = holder;
+              else
+                donate_from (holder, depth + 1);
+            }
         }
+      intr_set_level (old_level);
+      if (next == NULL)
+        break;
+      t = next;
+    }
+}
 
+/* T의 priority가 PRIORITY보다 낮다면 PRIORITY로 올립니다. lock이 아닌
+   동기화 도구(rwlock)가 holder에게 도네이션할 때 사용합니다. */
+void
+thread_raise_priority (struct thread *t, int priority) 
+{
+  if (t->priority < priority)
+    thread_change_priority (t, priority);
 }
 
 
@@ -551,6 +759,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* With -tickless, let the next timer interrupt come only
+         when some sleeping thread is due. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -601,7 +813,7 @@ is_thread (struct thread *t)
 
 /* Does basic initialization of T as a blocked thread named
    NAME. */
-/* 새로 만든 thread안에 변수들은 초기화시킵니다. priority_inst , dona_list, recent cpu,nice가 존재합니다.*/
+/* 새로 만든 thread안에 변수들은 초기화시킵니다. priority_inst , held_locks, recent cpu,nice가 존재합니다.*/
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
@@ -616,6 +828,9 @@ init_thread (struct thread *t, const char *name, int priority)
   t->priority = priority;
   t->magic = THREAD_MAGIC;
   t->priority_inst=priority;
+  t->recent_cpu_epoch = mlfqs_epoch;
+  list_init (&t->held_locks);
+  list_init (&t->rw_holds);
   
   if(t==initial_thread)
   {t->recent_cpu = 0;
@@ -623,7 +838,6 @@ init_thread (struct thread *t, const char *name, int priority)
   else 
   {t->nice = 0;
   t->recent_cpu = thread_current()->recent_cpu;}
-  list_init(&t->dona_list);
   list_push_back (&all_list, &t->allelem);
 }
 
@@ -645,13 +859,79 @@ alloc_frame (struct thread *t, size_t size)
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
    idle_thread. */
+/* ready_bitmap에서 가장 높은 비트를 찾아 그 priority의 큐 맨 앞 스레드를 꺼냅니다. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  struct thread *t;
+
+  if (ready_bitmap == 0)
     return idle_thread;
+  t = list_entry (list_front (&ready_queues[ready_max_priority ()]),
+                  struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* T를 T->priority에 해당하는 ready queue의 맨 뒤에 넣습니다.
+   인터럽트가 꺼진 상태에서 호출되어야 합니다. */
+static void
+ready_push (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_queues[t->priority - PRI_MIN], &t->elem);
+  ready_bitmap |= (uint64_t) 1 << (t->priority - PRI_MIN);
+  ready_cnt++;
+}
+
+/* ready queue에 들어있는 T를 꺼냅니다. 큐가 비게 되면 비트도 지웁니다. */
+static void
+ready_remove (struct thread *t) 
+{
+  int idx = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[idx]))
+    ready_bitmap &= ~((uint64_t) 1 << idx);
+  ready_cnt--;
+}
+
+/* ready queue에 있는 스레드 중 가장 높은 priority를 리턴합니다.
+   비어있다면 PRI_MIN - 1을 리턴합니다. */
+static int
+ready_max_priority (void) 
+{
+  uint32_t hi = ready_bitmap >> 32;
+  uint32_t lo = ready_bitmap;
+
+  if (hi != 0)
+    return PRI_MIN + 63 - __builtin_clz (hi);
+  else if (lo != 0)
+    return PRI_MIN + 31 - __builtin_clz (lo);
+  else
+    return PRI_MIN - 1;
+}
+
+/* T의 priority를 PRIORITY로 바꿉니다. T가 ready 상태라면 새 priority의
+   큐로 옮겨서 ready queue가 항상 올바른 위치에 있도록 합니다. */
+static void
+thread_change_priority (struct thread *t, int priority) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (t->priority != priority && t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    t->priority = priority;
+  intr_set_level (old_level);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -24,6 +24,23 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* 스레드가 rwlock을 잡고 있다는 기록입니다. (synch.c)
+   reader는 여러 명일 수 있으므로 rwlock은 holder 하나가 아니라
+   이 기록들의 리스트로 holder들을 관리합니다. 처음 몇 개는 struct thread
+   안의 칸을 쓰고, 그보다 많이 잡으면 malloc()으로 받습니다. */
+struct rwlock;
+struct rwlock_hold
+  {
+    struct rwlock *rwlock;              /* Held rwlock, or NULL if unused. */
+    struct thread *thread;              /* Thread holding RWLOCK. */
+    bool allocated;                     /* From malloc()? */
+    struct list_elem elem;              /* Element in rwlock's holders. */
+    struct list_elem thread_elem;       /* Element in thread's rw_holds. */
+  };
+
+/* struct thread 안에 두는 rwlock_hold 칸의 개수입니다. */
+#define RWLOCK_HOLD_SLOTS 4
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -98,21 +115,32 @@ struct thread
     int64_t wake_tick;
     /* 도네이션 효과를 받지않은 본연의 priority입니다.  */
     int priority_inst;
-    /* 도네이션을 해주는 스레드의 리스트입니다. */
-    struct list dona_list;
-    /* dona_list를 위한 list_elem자료구조입니다.*/
-    struct list_elem dona_elem;
+    /* 이 스레드가 가지고 있는 lock들의 리스트입니다. 도네이션은 lock마다 
+       max_priority로 모아두므로 priority는 이 리스트만 보고 다시 계산합니다. */
+    struct list held_locks;
+    /* 이 스레드가 잡고 있는 rwlock들의 rwlock_hold 리스트입니다. */
+    struct list rw_holds;
+    struct rwlock_hold rw_hold_slots[RWLOCK_HOLD_SLOTS];
     /* 묶여있는 lock을 가리키는 포인터입니다.*/
     struct lock * lock_pointing;
+    /* 기다리고 있는 rwlock을 가리키는 포인터입니다. */
+    struct rwlock *rwlock_pointing;
     /* mlfqs에서 사용하는 값들입니다.*/
     int nice;
     int recent_cpu;
+    /* recent_cpu에 몇 번째 1초 갱신까지 반영되었는지를 기억합니다. */
+    int recent_cpu_epoch;
 
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
 #endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, for lazy loading. */
+#endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
@@ -153,7 +181,9 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
-void donate_priority(void);
+void donate_priority(struct thread *);
+void thread_refresh_priority (struct thread *);
+void thread_raise_priority (struct thread *, int priority);
 
 void mlfqs_priority(struct thread * t);
 void mlfqs_recent_cpu(struct thread * t);
@@ -4,6 +4,9 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,6 +151,14 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* 없는 페이지에서 난 폴트는 보조 페이지 테이블로 해결합니다. 커널
+     모드에서는 f->esp가 사용자 스택 포인터가 아니므로 스택을 늘리지
+     않습니다. */
+  if (not_present && page_fault_in (fault_addr, user ? f->esp : NULL))
+    return;
+#endif
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
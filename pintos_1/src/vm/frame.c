@@ -0,0 +1,217 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include "vm/page.h"
+#include "vm/swap.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+
+/* 사용자 풀에서 받은 모든 프레임을 담는 전역 프레임 테이블입니다.
+   사용자 풀이 바닥나면 second-chance clock으로 희생 프레임을 골라
+   내용을 스왑에 쓰거나 버리고 그 프레임을 다시 씁니다.
+
+   frame_lock은 프레임 테이블과 clock_hand, 그리고 각 페이지의 frame,
+   type, evicting, swap_slot을 보호합니다. 쫓아낸 페이지를 스왑에 쓰는
+   동안에는 희생 프레임을 pin하고 페이지에 evicting을 표시한 뒤
+   frame_lock을 놓으므로, 다른 스레드는 그동안 다른 프레임을 받거나
+   쫓아낼 수 있습니다. 그 페이지를 다시 올리거나 놓으려는 스레드는
+   frame_evicted에서 쓰기가 끝나기를 기다렸다가 새 상태를 봅니다.
+
+   새로 받은 프레임은 pin된 채로 돌려주며, 내용을 채우고 페이지 테이블에
+   넣은 뒤에 frame_unpin()으로 풀어야 합니다. 커널이 사용자 페이지에 직접
+   읽어 넣을 때도 frame_pin()으로 그 프레임을 pin합니다. */
+
+static struct list frame_list;
+static struct list_elem *clock_hand;    /* Next frame to examine. */
+static struct lock frame_lock;
+static struct condition frame_evicted;  /* Signaled when evict() ends. */
+static struct kmem_cache *frame_cache;
+
+static struct frame *evict (void);
+static struct frame *next_frame (void);
+
+/* 프레임 테이블을 초기화합니다. */
+void
+frame_init (void)
+{
+  list_init (&frame_list);
+  clock_hand = list_end (&frame_list);
+  lock_init (&frame_lock);
+  cond_init (&frame_evicted);
+  frame_cache = kmem_cache_create (sizeof (struct frame), NULL);
+}
+
+/* PAGE를 담을 프레임을 pin된 상태로 돌려줍니다. 빈 프레임이 없으면
+   다른 프레임을 쫓아내고, 그마저 할 수 없으면 null pointer를 돌려줍니다. */
+struct frame *
+frame_alloc (struct page *page)
+{
+  struct frame *f;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  while (page->evicting)
+    cond_wait (&frame_evicted, &frame_lock);
+  ASSERT (page->frame == NULL);
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage != NULL)
+    {
+      f = kmem_cache_alloc (frame_cache);
+      if (f == NULL)
+        {
+          palloc_free_page (kpage);
+          lock_release (&frame_lock);
+          return NULL;
+        }
+      f->kpage = kpage;
+      list_push_back (&frame_list, &f->elem);
+    }
+  else
+    {
+      f = evict ();
+      if (f == NULL)
+        {
+          lock_release (&frame_lock);
+          return NULL;
+        }
+    }
+  f->page = page;
+  f->pinned = true;
+  page->frame = f;
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* 현재 스레드의 UPAGE를 담은 프레임을 pin하고 돌려줍니다. 커널이 그
+   프레임의 커널 주소로 직접 읽어 넣는 동안 쫓겨나지 않게 하며, 다
+   읽은 뒤에 frame_unpin()으로 풀어야 합니다. 페이지가 프레임에 없거나
+   이미 pin되어 있으면 null pointer를 돌려줍니다. */
+struct frame *
+frame_pin (const void *upage)
+{
+  struct page *p;
+  struct frame *f = NULL;
+
+  if (thread_current ()->pages == NULL)
+    return NULL;
+  p = page_lookup (upage);
+  if (p == NULL)
+    return NULL;
+
+  lock_acquire (&frame_lock);
+  if (p->frame != NULL && !p->frame->pinned)
+    {
+      f = p->frame;
+      f->pinned = true;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* 내용을 다 채운 프레임 F를 clock이 쫓아낼 수 있게 풉니다. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pinned);
+  f->pinned = false;
+  lock_release (&frame_lock);
+}
+
+/* PAGE가 프레임에 있으면 매핑을 지우고 프레임을 사용자 풀에 돌려줍니다.
+   PAGE가 쫓겨나는 중이면 끝나기를 기다립니다. */
+void
+frame_release (struct page *page)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  while (page->evicting)
+    cond_wait (&frame_evicted, &frame_lock);
+  f = page->frame;
+  if (f != NULL)
+    {
+      if (page->owner->pagedir != NULL)
+        pagedir_clear_page (page->owner->pagedir, page->upage);
+      if (clock_hand == &f->elem)
+        clock_hand = list_next (clock_hand);
+      list_remove (&f->elem);
+      palloc_free_page (f->kpage);
+      kmem_cache_free (frame_cache, f);
+      page->frame = NULL;
+    }
+  lock_release (&frame_lock);
+}
+
+/* clock_hand가 가리키는 프레임을 돌려주고 바늘을 한 칸 옮깁니다.
+   테이블의 끝에 닿으면 처음으로 돌아갑니다. */
+static struct frame *
+next_frame (void)
+{
+  struct frame *f;
+
+  if (clock_hand == list_end (&frame_list))
+    clock_hand = list_begin (&frame_list);
+  f = list_entry (clock_hand, struct frame, elem);
+  clock_hand = list_next (clock_hand);
+  return f;
+}
+
+/* second-chance clock으로 희생 프레임을 골라 비운 뒤 돌려줍니다.
+   최근에 접근된 프레임은 accessed 비트를 지우고 한 바퀴 더 기회를
+   줍니다. 더러운 페이지는 스왑에 쓰고, 깨끗한 페이지는 실행 파일이나
+   0으로 다시 채울 수 있으므로 그냥 버립니다. frame_lock을 잡고
+   호출해야 하며, 스왑에 쓰는 동안에는 frame_lock을 놓습니다. */
+static struct frame *
+evict (void)
+{
+  size_t i, n = 2 * list_size (&frame_list);
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  for (i = 0; i < n; i++)
+    {
+      struct frame *f = next_frame ();
+      struct page *p = f->page;
+      uint32_t *pd = p->owner->pagedir;
+
+      if (f->pinned)
+        continue;
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          continue;
+        }
+
+      /* 매핑을 먼저 지워야 스왑에 쓰는 동안 주인이 페이지를 고치지
+         못합니다. */
+      f->pinned = true;
+      pagedir_clear_page (pd, p->upage);
+      if (pagedir_is_dirty (pd, p->upage) || p->type == PAGE_SWAP)
+        {
+          size_t slot;
+
+          p->evicting = true;
+          lock_release (&frame_lock);
+          slot = swap_out (f->kpage);
+          lock_acquire (&frame_lock);
+          p->evicting = false;
+          if (slot == SWAP_ERROR)
+            {
+              pagedir_set_page (pd, p->upage, f->kpage, p->writable);
+              pagedir_set_dirty (pd, p->upage, true);
+              f->pinned = false;
+              cond_broadcast (&frame_evicted, &frame_lock);
+              return NULL;
+            }
+          p->type = PAGE_SWAP;
+          p->swap_slot = slot;
+          cond_broadcast (&frame_evicted, &frame_lock);
+        }
+      p->frame = NULL;
+      return f;
+    }
+  return NULL;
+}
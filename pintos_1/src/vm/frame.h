@@ -0,0 +1,24 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+
+struct page;
+
+/* A user page frame. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address of the frame. */
+    struct page *page;          /* Page held in the frame. */
+    bool pinned;                /* Pinned frames are never evicted. */
+    struct list_elem elem;      /* Element in the frame table. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *);
+struct frame *frame_pin (const void *upage);
+void frame_unpin (struct frame *);
+void frame_release (struct page *);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,235 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* 프로세스마다 하나씩 있는 보조 페이지 테이블입니다. 사용자 페이지마다
+   그 내용을 어디서 가져오는지(실행 파일, 0, 스왑)를 기록해 두고, 페이지
+   폴트가 나면 그때 프레임을 받아 내용을 채웁니다. 테이블 자체는 주인
+   스레드만 건드리므로 따로 lock이 없고, 엔트리의 frame, type, evicting,
+   swap_slot은 frame.c의 frame_lock이 보호합니다. */
+
+/* 스택이 자랄 수 있는 최대 크기입니다. */
+#define STACK_MAX (8 * 1024 * 1024)
+
+/* PUSHA는 esp보다 32바이트 아래까지 쓰고 나서 esp를 옮깁니다. */
+#define STACK_SLOP 32
+
+static struct kmem_cache *page_cache;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static bool page_add (void *upage, enum page_type, struct file *, off_t ofs,
+                      size_t read_bytes, bool writable);
+static bool page_load (struct page *);
+
+/* 페이지 엔트리를 담을 캐시를 만듭니다. */
+void
+page_init (void)
+{
+  page_cache = kmem_cache_create (sizeof (struct page), NULL);
+}
+
+/* 현재 스레드의 보조 페이지 테이블을 만듭니다. */
+bool
+page_table_create (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->pages == NULL);
+
+  t->pages = malloc (sizeof *t->pages);
+  if (t->pages == NULL)
+    return false;
+  if (!hash_init (t->pages, page_hash, page_less, NULL))
+    {
+      free (t->pages);
+      t->pages = NULL;
+      return false;
+    }
+  return true;
+}
+
+/* 현재 스레드의 보조 페이지 테이블과 그 페이지들이 쓰던 프레임, 스왑
+   슬롯을 모두 돌려줍니다. 페이지 디렉터리를 없애기 전에 호출해야
+   합니다. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->pages == NULL)
+    return;
+  hash_destroy (t->pages, page_destroy);
+  free (t->pages);
+  t->pages = NULL;
+}
+
+/* UPAGE를 FILE의 OFS부터 READ_BYTES 바이트를 읽고 나머지를 0으로
+   채우는 페이지로 등록합니다. 내용은 처음 접근할 때 읽습니다. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable)
+{
+  ASSERT (read_bytes <= PGSIZE);
+
+  if (read_bytes == 0)
+    return page_add_zero (upage, writable);
+  return page_add (upage, PAGE_FILE, file, ofs, read_bytes, writable);
+}
+
+/* UPAGE를 0으로 채워진 페이지로 등록합니다. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return page_add (upage, PAGE_ZERO, NULL, 0, 0, writable);
+}
+
+/* FAULT_ADDR에서 난 not-present 폴트를 처리합니다. 등록된 페이지면
+   내용을 채워 매핑하고, 등록되지 않았더라도 사용자 스택 포인터 ESP
+   바로 아래라면 스택을 한 페이지 늘립니다. ESP가 null pointer이면
+   스택을 늘리지 않습니다. 폴트를 해결하면 true를 돌려줍니다. */
+bool
+page_fault_in (void *fault_addr, void *esp)
+{
+  void *upage = pg_round_down (fault_addr);
+  struct page *p;
+
+  if (thread_current ()->pages == NULL || !is_user_vaddr (fault_addr))
+    return false;
+
+  p = page_lookup (upage);
+  if (p == NULL)
+    {
+      if (esp == NULL
+          || (uint8_t *) fault_addr < (uint8_t *) esp - STACK_SLOP
+          || (uint8_t *) fault_addr < (uint8_t *) PHYS_BASE - STACK_MAX
+          || !page_add_zero (upage, true))
+        return false;
+      p = page_lookup (upage);
+    }
+  return page_load (p);
+}
+
+/* P에 프레임을 주고 내용을 채운 뒤 주인의 페이지 디렉터리에 넣습니다.
+   P가 쫓겨나는 중이었다면 frame_alloc()이 쫓아내기가 끝날 때까지
+   기다리므로, 그 뒤에 읽는 type과 swap_slot은 최신 값입니다. */
+static bool
+page_load (struct page *p)
+{
+  struct frame *f = frame_alloc (p);
+
+  if (f == NULL)
+    return false;
+
+  switch (p->type)
+    {
+    case PAGE_ZERO:
+      memset (f->kpage, 0, PGSIZE);
+      break;
+    case PAGE_FILE:
+      if (file_read_at (p->file, f->kpage, p->read_bytes, p->ofs)
+          != (off_t) p->read_bytes)
+        {
+          frame_release (p);
+          return false;
+        }
+      memset ((uint8_t *) f->kpage + p->read_bytes, 0,
+              PGSIZE - p->read_bytes);
+      break;
+    case PAGE_SWAP:
+      swap_in (p->swap_slot, f->kpage);
+      p->swap_slot = SWAP_ERROR;
+      break;
+    default:
+      NOT_REACHED ();
+    }
+
+  if (!pagedir_set_page (p->owner->pagedir, p->upage, f->kpage, p->writable))
+    {
+      frame_release (p);
+      return false;
+    }
+  frame_unpin (f);
+  return true;
+}
+
+/* 현재 스레드의 테이블에 UPAGE 엔트리를 더합니다. 이미 등록된 주소면
+   false를 돌려줍니다. */
+static bool
+page_add (void *upage, enum page_type type, struct file *file, off_t ofs,
+          size_t read_bytes, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  p = kmem_cache_alloc (page_cache);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->owner = t;
+  p->writable = writable;
+  p->frame = NULL;
+  p->type = type;
+  p->evicting = false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->swap_slot = SWAP_ERROR;
+  if (hash_insert (t->pages, &p->elem) != NULL)
+    {
+      kmem_cache_free (page_cache, p);
+      return false;
+    }
+  return true;
+}
+
+/* 현재 스레드의 테이블에서 UPAGE 엔트리를 찾습니다. */
+struct page *
+page_lookup (const void *upage)
+{
+  struct page key;
+  struct hash_elem *e;
+
+  key.upage = (void *) upage;
+  e = hash_find (thread_current ()->pages, &key.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_int ((uintptr_t) p->upage >> PGBITS);
+}
+
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+  return a->upage < b->upage;
+}
+
+/* 엔트리 하나가 쓰던 프레임과 스왑 슬롯을 돌려주고 엔트리를 지웁니다. */
+static void
+page_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, elem);
+
+  frame_release (p);
+  if (p->type == PAGE_SWAP && p->swap_slot != SWAP_ERROR)
+    swap_free (p->swap_slot);
+  kmem_cache_free (page_cache, p);
+}
@@ -0,0 +1,45 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+/* Where a page's contents come from when it is not in a frame. */
+enum page_type
+  {
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_FILE,                  /* Read from a file, rest zeroed. */
+    PAGE_SWAP                   /* Saved in a swap slot. */
+  };
+
+/* A user page in a process's supplemental page table. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    struct thread *owner;       /* Owning thread. */
+    bool writable;              /* Writable by the user process? */
+    struct frame *frame;        /* Frame holding the page, or null. */
+    enum page_type type;        /* Backing store when not in a frame. */
+    bool evicting;              /* Being written out of its frame? */
+
+    struct file *file;          /* PAGE_FILE: file to read. */
+    off_t ofs;                  /* PAGE_FILE: offset in FILE. */
+    size_t read_bytes;          /* PAGE_FILE: bytes to read. */
+    size_t swap_slot;           /* PAGE_SWAP: slot holding the page. */
+
+    struct hash_elem elem;      /* Element in the owner's page table. */
+  };
+
+void page_init (void);
+bool page_table_create (void);
+void page_table_destroy (void);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_fault_in (void *fault_addr, void *esp);
+struct page *page_lookup (const void *upage);
+
+#endif /* vm/page.h */
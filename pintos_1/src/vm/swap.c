@@ -0,0 +1,71 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* 쫓겨난 페이지를 담아 두는 스왑 장치입니다. 장치를 페이지 크기의 슬롯으로
+   나누고, 쓰이고 있는 슬롯을 swap_map에 표시합니다. 스왑 장치가 없으면
+   모든 슬롯이 쓰이고 있는 것처럼 동작합니다. */
+
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;
+static struct bitmap *swap_map;         /* Slots in use. */
+static struct lock swap_lock;           /* Protects swap_map. */
+
+/* 스왑 장치를 찾아 슬롯 비트맵을 만듭니다. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size (swap_device) / SECTORS_PER_PAGE;
+  swap_map = bitmap_create (slot_cnt);
+  if (swap_map == NULL)
+    PANIC ("couldn't allocate swap bitmap");
+}
+
+/* KPAGE의 내용을 빈 슬롯에 쓰고 그 슬롯 번호를 돌려줍니다. 페이지의
+   섹터들은 요청 하나로 씁니다. 빈 슬롯이 없으면 SWAP_ERROR를
+   돌려줍니다. */
+size_t
+swap_out (const void *kpage)
+{
+  size_t slot;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_map, 0, 1, false);
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_ERROR;
+
+  block_write_range (swap_device, slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE,
+                     kpage);
+  return slot;
+}
+
+/* SLOT의 내용을 KPAGE로 읽어 들이고 슬롯을 비웁니다. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  ASSERT (bitmap_test (swap_map, slot));
+
+  block_read_range (swap_device, slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE,
+                    kpage);
+  swap_free (slot);
+}
+
+/* 내용을 읽지 않고 SLOT을 비웁니다. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  bitmap_reset (swap_map, slot);
+  lock_release (&swap_lock);
+}